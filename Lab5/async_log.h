@@ -0,0 +1,249 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+// Binary asynchronous logger for the producer.
+// The hot path only stores a fixed-size record in its thread's single-producer/single-consumer ring.
+// A background thread formats the records and writes them to stderr in batches.
+// When a ring is full the record is dropped and counted, logging never blocks the caller.
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_RING_SIZE (1 << 14)     // Records per thread, a power of two
+#define LOG_FLUSH_MS 10             // How often the background thread looks for records
+
+enum LogLevel {
+    LOG_OFF = 0,
+    LOG_INFO = 1,       // Generated, placed and sleeping (what the producer always printed)
+    LOG_DEBUG = 2       // Also the mutex waits and critical section entry/exit
+};
+
+enum LogEvent {
+    EV_GENERATED = 0,   // value: price
+    EV_PLACED,          // value: price
+    EV_SLEEPING,        // value: sleep in ms
+    EV_MUTEX_WAIT,      // waiting for room and the mutex
+    EV_MUTEX_ENTERED,   // entered the critical section (timestamp taken inside, logged after unlocking)
+    EV_MUTEX_EXITED,    // left the critical section
+    EV_COUNT
+};
+
+struct LogRecord {
+    uint64_t ts_ns;     // CLOCK_MONOTONIC nanoseconds
+    double value;
+    uint16_t event;     // One of LogEvent
+    uint16_t source;    // Commodity index
+    uint32_t reserved;
+};
+static_assert(sizeof(LogRecord) == 24, "LogRecord must stay 24 bytes");
+
+// Allocated with new, so the indexes are kept on separate cache lines with padding rather than alignas
+struct LogRing {
+    LogRecord records[LOG_RING_SIZE];
+    std::atomic<uint64_t> tail;         // Next record written by the owning thread
+    char pad1[64];
+    std::atomic<uint64_t> head;         // Next record read by the background thread
+    char pad2[64];
+    uint64_t dropped;                   // Records lost because the ring was full (owner only)
+
+    LogRing() : tail(0), head(0), dropped(0) {}
+};
+
+inline uint64_t log_clock() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+class AsyncLogger {
+public:
+    AsyncLogger() : level_(LOG_INFO), running_(false), names_(nullptr), offset_ns_(0) {}
+
+    // exit() from any thread ends here, the writer thread must not be left joinable
+    ~AsyncLogger() {
+        stop();
+    }
+
+    // names maps LogRecord::source to a printable name
+    void start(int level, const char* const* names) {
+        level_.store(level, std::memory_order_relaxed);
+        names_ = names;
+
+        // Wall clock minus monotonic clock, to print records in local time
+        timespec real;
+        clock_gettime(CLOCK_REALTIME, &real);
+        offset_ns_ = (int64_t)((uint64_t)real.tv_sec * 1000000000ull + real.tv_nsec) - (int64_t)log_clock();
+
+        // The writer thread must not take SIGINT, the caller's handler stops it
+        sigset_t block, old;
+        sigemptyset(&block);
+        sigaddset(&block, SIGINT);
+        pthread_sigmask(SIG_BLOCK, &block, &old);
+        running_.store(true);
+        writer_ = std::thread(&AsyncLogger::writer_loop, this);
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    }
+
+    // Write out everything still queued and stop the background thread
+    void stop() {
+        if (!running_.exchange(false)) {
+            return;
+        }
+        writer_.join();
+        drain();
+        uint64_t dropped = 0;
+        for (size_t i = 0; i < rings_.size(); i++) {
+            dropped += rings_[i]->dropped;
+        }
+        if (dropped > 0) {
+            fprintf(stderr, "Logger dropped %llu records (ring full).\n", (unsigned long long)dropped);
+        }
+    }
+
+    bool enabled(int level) const {
+        return level <= level_.load(std::memory_order_relaxed);
+    }
+
+    void log(int level, int event, int source, double value = 0, uint64_t ts_ns = 0) {
+        if (!enabled(level)) {
+            return;
+        }
+        LogRing* ring = thread_ring();
+        uint64_t pos = ring->tail.load(std::memory_order_relaxed);
+        if (pos - ring->head.load(std::memory_order_acquire) == LOG_RING_SIZE) {
+            ring->dropped++;
+            return;
+        }
+        LogRecord& r = ring->records[pos & (LOG_RING_SIZE - 1)];
+        r.ts_ns = ts_ns ? ts_ns : log_clock();
+        r.value = value;
+        r.event = event;
+        r.source = source;
+        r.reserved = 0;
+        ring->tail.store(pos + 1, std::memory_order_release);
+    }
+
+private:
+    // Ring of the calling thread, registered on first use
+    LogRing* thread_ring() {
+        static thread_local LogRing* ring = nullptr;
+        if (!ring) {
+            ring = new LogRing();
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings_.push_back(ring);
+        }
+        return ring;
+    }
+
+    void writer_loop() {
+        while (running_.load()) {
+            drain();
+            usleep(LOG_FLUSH_MS * 1000);
+        }
+    }
+
+    // Format every queued record and write them with one write() per ring
+    void drain() {
+        std::vector<LogRing*> rings;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings = rings_;
+        }
+        for (size_t i = 0; i < rings.size(); i++) {
+            LogRing* ring = rings[i];
+            uint64_t head = ring->head.load(std::memory_order_relaxed);
+            uint64_t tail = ring->tail.load(std::memory_order_acquire);
+            if (head == tail) {
+                continue;
+            }
+            out_.clear();
+            for (; head != tail; head++) {
+                format(ring->records[head & (LOG_RING_SIZE - 1)], out_);
+            }
+            ring->head.store(head, std::memory_order_release);
+            write_out(out_);
+        }
+    }
+
+    void format(const LogRecord& r, std::string& out) {
+        uint64_t real_ns = r.ts_ns + offset_ns_;
+        time_t sec = real_ns / 1000000000ull;
+        struct tm local;
+        localtime_r(&sec, &local);
+        char line[160];
+        size_t n = strftime(line, sizeof(line), "[%m/%d/%Y %H:%M:%S.", &local);
+        n += snprintf(line + n, sizeof(line) - n, "%03u] %s: ", (unsigned)(real_ns / 1000000 % 1000), names_[r.source]);
+        switch (r.event) {
+        case EV_GENERATED:
+            snprintf(line + n, sizeof(line) - n, "generating a new value %g\n", r.value);
+            break;
+        case EV_PLACED:
+            snprintf(line + n, sizeof(line) - n, "placing %g on shared buffer\n", r.value);
+            break;
+        case EV_SLEEPING:
+            snprintf(line + n, sizeof(line) - n, "sleeping for %g ms\n", r.value);
+            break;
+        case EV_MUTEX_WAIT:
+            snprintf(line + n, sizeof(line) - n, "trying to get mutex on shared buffer\n");
+            break;
+        case EV_MUTEX_ENTERED:
+            snprintf(line + n, sizeof(line) - n, "waited on mutex and entered critical section\n");
+            break;
+        case EV_MUTEX_EXITED:
+            snprintf(line + n, sizeof(line) - n, "exited the critical section\n");
+            break;
+        default:
+            snprintf(line + n, sizeof(line) - n, "unknown event %u\n", (unsigned)r.event);
+        }
+        out += line;
+    }
+
+    static void write_out(const std::string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = write(STDERR_FILENO, data.data() + done, data.size() - done);
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            done += n;
+        }
+    }
+
+    std::atomic<int> level_;
+    std::atomic<bool> running_;
+    const char* const* names_;
+    int64_t offset_ns_;
+    std::thread writer_;
+    std::mutex rings_mutex_;            // Guards rings_, taken once per thread and once per drain
+    std::vector<LogRing*> rings_;
+    std::string out_;                   // Formatting buffer of the background thread
+};
+
+// Parse a --log-level value. Returns -1 if it isn't one.
+inline int log_parse_level(const char* name) {
+    if (strcmp(name, "off") == 0) {
+        return LOG_OFF;
+    }
+    if (strcmp(name, "info") == 0) {
+        return LOG_INFO;
+    }
+    if (strcmp(name, "debug") == 0) {
+        return LOG_DEBUG;
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,371 @@
+// Benchmark driver: runs the consumer headless with N producers for every combination of the sweep
+// (transport x buffer size x producer count x batch size), then writes ticks/sec, latency percentiles
+// and context switches of each run as CSV and JSON. Every producer publishes its own symbol.
+// When the sweep has the sharded transport it also runs SHARD_COUNT and 2 * SHARD_COUNT producers:
+// symbol ids spread over the shards by id % SHARD_COUNT, so in the second case every shard ring is
+// shared by two producers of different symbols and the cost of that contention shows.
+//
+// Usage: ./benchmark [--duration S] [--transports sem,lockfree,...] [--buffers 64,4096] [--producers 1,4]
+//                    [--batches 1,32] [--sleep-ms MS] [--seed N] [--no-pin] [--no-shard-collisions]
+//                    [--csv FILE] [--json FILE]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "shared_buffer.h"
+#include "cpu_affinity.h"
+
+
+struct BenchConfig {
+    std::string transport;
+    int buffer_size;
+    int producers;
+    int batch;
+};
+
+struct BenchResult {
+    BenchConfig config;
+    std::map<std::string, std::string> report;     // Consumer's --report line
+    long producer_voluntary_cs;
+    long producer_involuntary_cs;
+};
+
+std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::vector<int> split_ints(const std::string& list) {
+    std::vector<int> values;
+    std::vector<std::string> items = split_list(list);
+    for (size_t i = 0; i < items.size(); i++) {
+        values.push_back(std::stoi(items[i]));
+    }
+    return values;
+}
+
+// fork + exec with stdout/stderr discarded. Returns the child's pid, or -1.
+pid_t spawn(const std::vector<std::string>& args) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork failed");
+        return -1;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            close(null_fd);
+        }
+        std::vector<char*> argv;
+        for (size_t i = 0; i < args.size(); i++) {
+            argv.push_back(const_cast<char*>(args[i].c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+// Wait until the consumer has published the header of the named segment
+bool wait_for_segment(const std::string& name, pid_t consumer) {
+    for (int attempt = 0; attempt < 5000; attempt++) {
+        int status;
+        if (waitpid(consumer, &status, WNOHANG) == consumer) {
+            std::cerr << "Error: the consumer exited during startup.\n";
+            return false;
+        }
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd != -1) {
+            struct stat st;
+            bool ready = false;
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SharedHeader)) {
+                void* addr = mmap(nullptr, sizeof(SharedHeader), PROT_READ, MAP_SHARED, fd, 0);
+                if (addr != MAP_FAILED) {
+                    ready = static_cast<SharedHeader*>(addr)->magic.load() == SHARED_BUFFER_MAGIC;
+                    munmap(addr, sizeof(SharedHeader));
+                }
+            }
+            close(fd);
+            if (ready) {
+                return true;
+            }
+        }
+        usleep(1000);
+    }
+    std::cerr << "Error: timed out waiting for the consumer.\n";
+    return false;
+}
+
+// Stop a producer with SIGINT (SIGKILL if it doesn't exit within a second) and collect its rusage
+void stop_producer(pid_t pid, struct rusage& usage) {
+    memset(&usage, 0, sizeof(usage));
+    kill(pid, SIGINT);
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        int status;
+        if (wait4(pid, &status, WNOHANG, &usage) == pid) {
+            return;
+        }
+        usleep(1000);
+    }
+    kill(pid, SIGKILL);
+    int status;
+    wait4(pid, &status, 0, &usage);
+}
+
+// Symbol of the i-th producer: the consumer's default symbols first (ids 0 to DEFAULT_SYMBOL_COUNT - 1),
+// then names of our own, so n producers publish ids 0 to n - 1
+std::string producer_symbol(int i) {
+    return i < DEFAULT_SYMBOL_COUNT ? DEFAULT_SYMBOLS[i] : "BENCH" + std::to_string(i);
+}
+
+bool run_config(const BenchConfig& config, int duration, double sleep_ms, unsigned long seed, bool pin, BenchResult& result) {
+    std::string name = "/lab5_bench_" + std::to_string(getpid());
+    std::string report_path = "/tmp/lab5_bench_" + std::to_string(getpid()) + ".txt";
+    int cpus = cpu_count();
+    unlink(report_path.c_str());
+
+    std::vector<std::string> consumer_args = {
+        "./consumer", std::to_string(config.buffer_size), config.transport, "--headless",
+        "--duration", std::to_string(duration), "--report", report_path, "--shm", name
+    };
+    if (pin) {
+        consumer_args.push_back("--cpu");
+        consumer_args.push_back("0");
+    }
+    pid_t consumer = spawn(consumer_args);
+    if (consumer == -1 || !wait_for_segment(name, consumer)) {
+        if (consumer != -1) {
+            kill(consumer, SIGINT);
+            waitpid(consumer, nullptr, 0);
+        }
+        return false;
+    }
+
+    std::vector<pid_t> producers;
+    std::ostringstream sleep_arg;
+    sleep_arg << sleep_ms;
+    for (int i = 0; i < config.producers; i++) {
+        std::vector<std::string> args = {
+            "./producer", producer_symbol(i), "100", "5", sleep_arg.str(),
+            "--batch", std::to_string(config.batch), "--log-level", "off",
+            "--seed", std::to_string(seed + i), "--shm", name
+        };
+        if (pin) {
+            // The consumer has CPU 0 to itself when there are enough CPUs
+            args.push_back("--cpu");
+            args.push_back(std::to_string(cpus > 1 ? 1 + i % (cpus - 1) : 0));
+        }
+        pid_t pid = spawn(args);
+        if (pid != -1) {
+            producers.push_back(pid);
+        }
+    }
+
+    // The consumer exits on its own after --duration and writes the report
+    int status;
+    waitpid(consumer, &status, 0);
+    result.config = config;
+    result.producer_voluntary_cs = 0;
+    result.producer_involuntary_cs = 0;
+    for (size_t i = 0; i < producers.size(); i++) {
+        struct rusage usage;
+        stop_producer(producers[i], usage);
+        result.producer_voluntary_cs += usage.ru_nvcsw;
+        result.producer_involuntary_cs += usage.ru_nivcsw;
+    }
+    // The consumer leaves the segment (and its semaphores) behind while producers still run, remove them now
+    pid_t reset = spawn({"./consumer", "--reset", "--shm", name});
+    if (reset != -1) {
+        waitpid(reset, &status, 0);
+    }
+
+    std::ifstream report(report_path.c_str());
+    std::string field;
+    result.report.clear();
+    while (report >> field) {
+        size_t eq = field.find('=');
+        if (eq != std::string::npos) {
+            result.report[field.substr(0, eq)] = field.substr(eq + 1);
+        }
+    }
+    unlink(report_path.c_str());
+    if (result.report.empty()) {
+        std::cerr << "Error: the consumer wrote no report.\n";
+        return false;
+    }
+    return true;
+}
+
+// Columns taken from the consumer's report, in output order
+const char* report_columns[] = {
+    "ticks", "seconds", "ticks_per_sec", "queue_p50", "queue_p99", "queue_p999",
+    "e2e_p50", "e2e_p99", "e2e_p999", "e2e_max", "lock_wait_p99", "skipped", "voluntary_cs", "involuntary_cs"
+};
+const int report_column_count = sizeof(report_columns) / sizeof(report_columns[0]);
+
+std::string report_value(const BenchResult& r, const char* key) {
+    std::map<std::string, std::string>::const_iterator it = r.report.find(key);
+    return it == r.report.end() ? "0" : it->second;
+}
+
+void write_csv(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream out(path.c_str());
+    out << "transport,buffer_size,producers,batch";
+    for (int c = 0; c < report_column_count; c++) {
+        out << "," << report_columns[c];
+    }
+    out << ",producer_voluntary_cs,producer_involuntary_cs\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << r.config.transport << "," << r.config.buffer_size << "," << r.config.producers << "," << r.config.batch;
+        for (int c = 0; c < report_column_count; c++) {
+            out << "," << report_value(r, report_columns[c]);
+        }
+        out << "," << r.producer_voluntary_cs << "," << r.producer_involuntary_cs << "\n";
+    }
+}
+
+void write_json(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream out(path.c_str());
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "  {\"transport\": \"" << r.config.transport << "\", \"buffer_size\": " << r.config.buffer_size
+            << ", \"producers\": " << r.config.producers << ", \"batch\": " << r.config.batch;
+        for (int c = 0; c < report_column_count; c++) {
+            out << ", \"" << report_columns[c] << "\": " << report_value(r, report_columns[c]);
+        }
+        out << ", \"producer_voluntary_cs\": " << r.producer_voluntary_cs
+            << ", \"producer_involuntary_cs\": " << r.producer_involuntary_cs << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+// Run one configuration and print its row. Returns false if it was skipped.
+bool run_and_print(const BenchConfig& config, int duration, double sleep_ms, unsigned long seed, bool pin,
+                   std::vector<BenchResult>& results) {
+    if (config.batch > config.buffer_size || (config.transport == "sem" && config.buffer_size > MAX_SEM_BUFFER_SIZE)) {
+        return false;   // The consumer or producers would refuse it
+    }
+    BenchResult result;
+    if (!run_config(config, duration, sleep_ms, seed, pin, result)) {
+        std::cerr << "Run " << config.transport << "/" << config.buffer_size << "/" << config.producers
+                  << "/" << config.batch << " failed, skipped.\n";
+        return false;
+    }
+    long switches = std::stol(report_value(result, "voluntary_cs")) + std::stol(report_value(result, "involuntary_cs"))
+                  + result.producer_voluntary_cs + result.producer_involuntary_cs;
+    printf("%-9s %8d %9d %6d %12s %9s %9s %9s %12ld\n", config.transport.c_str(), config.buffer_size,
+           config.producers, config.batch, report_value(result, "ticks_per_sec").c_str(),
+           report_value(result, "e2e_p50").c_str(), report_value(result, "e2e_p99").c_str(),
+           report_value(result, "e2e_p999").c_str(), switches);
+    fflush(stdout);
+    results.push_back(result);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int duration = 2;
+    std::vector<std::string> transports = split_list("sem,lockfree,sharded");
+    std::vector<int> buffers = split_ints("64,4096");
+    std::vector<int> producer_counts = split_ints("1,4");
+    std::vector<int> batches = split_ints("1,32");
+    double sleep_ms = 0;
+    unsigned long seed = 42;
+    bool pin = true;
+    bool shard_collisions = true;
+    std::string csv_path = "bench.csv";
+    std::string json_path = "bench.json";
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--duration") == 0 && has_value) {
+            duration = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--transports") == 0 && has_value) {
+            transports = split_list(argv[++i]);
+        } else if (strcmp(argv[i], "--buffers") == 0 && has_value) {
+            buffers = split_ints(argv[++i]);
+        } else if (strcmp(argv[i], "--producers") == 0 && has_value) {
+            producer_counts = split_ints(argv[++i]);
+        } else if (strcmp(argv[i], "--batches") == 0 && has_value) {
+            batches = split_ints(argv[++i]);
+        } else if (strcmp(argv[i], "--sleep-ms") == 0 && has_value) {
+            sleep_ms = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            seed = std::stoul(argv[++i]);
+        } else if (strcmp(argv[i], "--no-pin") == 0) {
+            pin = false;
+        } else if (strcmp(argv[i], "--no-shard-collisions") == 0) {
+            shard_collisions = false;
+        } else if (strcmp(argv[i], "--csv") == 0 && has_value) {
+            csv_path = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else {
+            std::cerr << "Error unknown option " << argv[i] << ".\n"
+                         "Usage: ./benchmark [--duration S] [--transports sem,lockfree,...] [--buffers 64,4096] [--producers 1,4]\n"
+                         "                   [--batches 1,32] [--sleep-ms MS] [--seed N] [--no-pin] [--no-shard-collisions]\n"
+                         "                   [--csv FILE] [--json FILE]\n";
+            return 1;
+        }
+    }
+    if (duration < 1) {
+        std::cerr << "Error Invalid duration, must be at least 1 second.\n";
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    printf("%-9s %8s %9s %6s %12s %9s %9s %9s %12s\n", "TRANSPORT", "BUFFER", "PRODUCERS", "BATCH",
+           "TICKS/SEC", "E2E P50", "E2E P99", "E2E P999", "CTX SWITCHES");
+    for (size_t t = 0; t < transports.size(); t++) {
+        for (size_t b = 0; b < buffers.size(); b++) {
+            for (size_t p = 0; p < producer_counts.size(); p++) {
+                for (size_t n = 0; n < batches.size(); n++) {
+                    BenchConfig config = { transports[t], buffers[b], producer_counts[p], batches[n] };
+                    run_and_print(config, duration, sleep_ms, seed, pin, results);
+                }
+            }
+        }
+    }
+    // One producer per shard, then two producers of different symbols on every shard
+    if (shard_collisions && std::find(transports.begin(), transports.end(), "sharded") != transports.end()) {
+        int buffer = *std::max_element(buffers.begin(), buffers.end());
+        for (size_t n = 0; n < batches.size(); n++) {
+            for (int producers = SHARD_COUNT; producers <= 2 * SHARD_COUNT; producers += SHARD_COUNT) {
+                BenchConfig config = { "sharded", buffer, producers, batches[n] };
+                run_and_print(config, duration, sleep_ms, seed, pin, results);
+            }
+        }
+    }
+
+    write_csv(csv_path, results);
+    write_json(json_path, results);
+    printf("Wrote %s and %s.\n", csv_path.c_str(), json_path.c_str());
+    return 0;
+}
@@ -0,0 +1,425 @@
+// Forward ticks from one shared buffer to another over a stream socket, so producers and consumers can
+// live in different shm namespaces (containers, NUMA nodes, hosts).
+//   ./bridge send ADDRESS   reads a broadcast ring as one more reader (like consumer --attach) and sends
+//                           every batch it drains as a frame
+//   ./bridge recv ADDRESS   accepts a sender and places its ticks on the local buffer like a producer
+// ADDRESS is unix:PATH or tcp:HOST:PORT (recv also takes tcp:PORT). Frames are sent with writev, or with
+// sendmsg(MSG_ZEROCOPY) for --zerocopy on TCP, straight from the buffers the ring was drained into.
+// Symbol ids differ between segments: the sender names each id once before using it, the receiver
+// registers the names locally. Tick frames carry the ring position of their first tick, so the receiver
+// counts the ticks a lossy sender skipped. Timestamps are kept, so latency figures span the bridge
+// (only meaningful when both ends share CLOCK_MONOTONIC, i.e. the same host).
+//
+// Usage: ./bridge send ADDRESS [--lossy] [--batch N] [--zerocopy] [--shm NAME] [--hugepages]
+//        ./bridge recv ADDRESS [--shm NAME] [--hugepages]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+
+#include "shared_buffer.h"
+#include "shm_backend.h"
+#include "socket_address.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+#define BRIDGE_MAGIC 0x5242354Cu        // "L5BR"
+#define BRIDGE_VERSION 1
+#define BRIDGE_ZEROCOPY_BUFFERS 8       // Batches that may be in flight with MSG_ZEROCOPY
+#define BRIDGE_ZEROCOPY_MIN 16384       // Smaller frames are copied, pinning pages costs more than that
+
+enum BridgeFrameType {
+    BRIDGE_HELLO = 0,       // First frame: protocol version, record sizes must match
+    BRIDGE_SYMBOLS = 1,     // count BridgeSymbol records
+    BRIDGE_TICKS = 2        // count Tick records
+};
+
+struct BridgeFrame {
+    uint32_t magic;
+    uint16_t type;          // One of BridgeFrameType
+    uint16_t version;
+    uint32_t count;         // Records following the frame
+    uint32_t record_size;   // Size of each record, checked by the receiver
+    uint64_t position;      // Ticks: ring position of the first tick (gaps show up as jumps)
+};
+
+struct BridgeSymbol {
+    uint32_t id;            // Sender's symbol id
+    char name[SYMBOL_NAME_SIZE];
+};
+
+// Where a batch is drained into and sent from. With MSG_ZEROCOPY it stays untouched until the
+// kernel reports the send done.
+struct BridgeBuffer {
+    BridgeFrame frame;
+    std::vector<Tick> ticks;
+    uint32_t send_id;       // Last zerocopy send that used it
+    bool in_flight;
+};
+
+ShmSegment segment;
+SharedBuffer* shared_buffer = nullptr;
+ReaderCursor* reader = nullptr;                 // Sender
+std::atomic<int>* producer_entry = nullptr;     // Receiver
+ProducerMetrics* metrics = nullptr;
+std::string unix_path;                          // Receiver's socket file, removed on exit
+bool sending = false;
+
+uint64_t frames = 0;
+uint64_t ticks = 0;
+uint64_t skipped = 0;           // Sender: lapped by the producers (lossy). Receiver: gaps seen in positions.
+uint64_t unregistered = 0;      // Receiver: dropped because their symbol couldn't be registered here (registry full)
+uint64_t zerocopy_sends = 0;
+uint64_t zerocopy_copied = 0;   // Zerocopy sends the kernel ended up copying (always the case on loopback)
+
+void handle_sigint(int sig) {
+    (void)sig;
+    if (sending) {
+        printf("Sent %llu ticks in %llu frames, %llu skipped.\n", (unsigned long long)ticks, (unsigned long long)frames,
+               (unsigned long long)skipped);
+        if (zerocopy_sends > 0) {
+            printf("Zerocopy: %llu sends, %llu copied by the kernel.\n", (unsigned long long)zerocopy_sends,
+                   (unsigned long long)zerocopy_copied);
+        }
+        if (reader) {
+            broadcast_unregister(shared_buffer, reader);
+        }
+    } else {
+        printf("Received %llu ticks in %llu frames, %llu missing, %llu dropped for unregistered symbols.\n",
+               (unsigned long long)ticks, (unsigned long long)frames, (unsigned long long)skipped,
+               (unsigned long long)unregistered);
+        producer_unregister(producer_entry);
+        if (!unix_path.empty()) {
+            unlink(unix_path.c_str());
+        }
+    }
+    shm_detach(segment);
+    exit(0);
+}
+
+// ---------------------------------------- Sockets ----------------------------------------
+
+// Send every byte of iov, resuming after short writes. Returns false after printing the error.
+bool send_all(int fd, iovec* iov, int iovcnt, int flags) {
+    while (iovcnt > 0) {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t sent = sendmsg(fd, &msg, flags | MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to send to the receiver");
+            return false;
+        }
+        if (flags & MSG_ZEROCOPY) {
+            zerocopy_sends++;
+        }
+        while (iovcnt > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+bool recv_all(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Read zerocopy completions off the socket's error queue (waiting for one if block).
+// Returns the number of zerocopy sends completed so far.
+uint32_t reap_zerocopy(int fd, bool block, uint32_t completed) {
+    if (block) {
+        pollfd p = {fd, 0, 0};      // POLLERR is always reported
+        poll(&p, 1, -1);
+    }
+    while (true) {
+        char control[128];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            return completed;
+        }
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            const sock_extended_err* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // Sends ee_info..ee_data are done, in order on a TCP socket
+            completed = err->ee_data + 1;
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zerocopy_copied += err->ee_data - err->ee_info + 1;
+            }
+        }
+    }
+}
+
+// ---------------------------------------- Sender ----------------------------------------
+
+int run_sender(int fd, bool tcp, bool lossy, int batch_size, bool zerocopy) {
+    reader = broadcast_register(shared_buffer, lossy);
+    if (!reader) {
+        std::cerr << "Error: all " << MAX_READERS << " reader cursors are in use.\n";
+        return 1;
+    }
+    if (tcp) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));     // A batch is ready to go as it is
+    }
+    if (zerocopy && (!tcp || setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &zerocopy, sizeof(int)) == -1)) {
+        printf("MSG_ZEROCOPY is not available on this socket, sending copies.\n");
+        zerocopy = false;
+    }
+
+    BridgeFrame hello = {BRIDGE_MAGIC, BRIDGE_HELLO, BRIDGE_VERSION, 0, sizeof(Tick), 0};
+    iovec hello_iov = {&hello, sizeof(hello)};
+    if (!send_all(fd, &hello_iov, 1, 0)) {
+        return 1;
+    }
+
+    std::vector<BridgeBuffer> buffers(zerocopy ? BRIDGE_ZEROCOPY_BUFFERS : 1);
+    for (size_t i = 0; i < buffers.size(); i++) {
+        buffers[i].ticks.resize(batch_size);
+        buffers[i].in_flight = false;
+    }
+    std::vector<bool> announced(MAX_SYMBOLS, false);
+    std::vector<BridgeSymbol> symbols;
+    uint32_t zerocopy_issued = 0, zerocopy_done = 0;
+    size_t next = 0;
+
+    while (true) {
+        BridgeBuffer& buffer = buffers[next];
+        next = (next + 1) % buffers.size();
+        while (buffer.in_flight && (int32_t)(zerocopy_done - buffer.send_id) <= 0) {
+            zerocopy_done = reap_zerocopy(fd, true, zerocopy_done);
+        }
+        buffer.in_flight = false;
+
+        int n = broadcast_pop_batch(shared_buffer, reader, buffer.ticks.data(), batch_size, skipped);
+        uint64_t position = reader->position.load(std::memory_order_relaxed) - n;
+
+        // Name the ids this batch uses for the first time
+        symbols.clear();
+        for (int i = 0; i < n; i++) {
+            int id = buffer.ticks[i].comm_index;
+            if (id < MAX_SYMBOLS && !announced[id]) {
+                announced[id] = true;
+                BridgeSymbol symbol;
+                symbol.id = id;
+                memcpy(symbol.name, symbol_name(&shared_buffer->symbols, id), SYMBOL_NAME_SIZE);
+                symbols.push_back(symbol);
+            }
+        }
+        if (!symbols.empty()) {
+            BridgeFrame frame = {BRIDGE_MAGIC, BRIDGE_SYMBOLS, BRIDGE_VERSION, (uint32_t)symbols.size(), sizeof(BridgeSymbol), 0};
+            iovec iov[2] = {{&frame, sizeof(frame)}, {symbols.data(), symbols.size() * sizeof(BridgeSymbol)}};
+            if (!send_all(fd, iov, 2, 0)) {
+                return 1;
+            }
+        }
+
+        BridgeFrame& frame = buffer.frame;
+        frame = {BRIDGE_MAGIC, BRIDGE_TICKS, BRIDGE_VERSION, (uint32_t)n, sizeof(Tick), position};
+        iovec iov[2] = {{&frame, sizeof(frame)}, {buffer.ticks.data(), n * sizeof(Tick)}};
+        bool copy = !zerocopy || sizeof(frame) + n * sizeof(Tick) < BRIDGE_ZEROCOPY_MIN;
+        uint64_t sends_before = zerocopy_sends;
+        if (!send_all(fd, iov, 2, copy ? 0 : MSG_ZEROCOPY)) {
+            return 1;
+        }
+        if (!copy) {
+            zerocopy_issued += (uint32_t)(zerocopy_sends - sends_before);
+            buffer.send_id = zerocopy_issued - 1;
+            buffer.in_flight = true;
+            zerocopy_done = reap_zerocopy(fd, false, zerocopy_done);
+        }
+        frames++;
+        ticks += n;
+    }
+}
+
+// ---------------------------------------- Receiver ----------------------------------------
+
+// Forward one sender's frames until it disconnects. Returns false on a protocol error.
+bool receive_connection(int fd) {
+    BridgeFrame frame;
+    if (!recv_all(fd, &frame, sizeof(frame)) || frame.magic != BRIDGE_MAGIC || frame.type != BRIDGE_HELLO ||
+        frame.version != BRIDGE_VERSION || frame.record_size != sizeof(Tick)) {
+        std::cerr << "Error: the sender doesn't speak this bridge protocol (or is a different build).\n";
+        return false;
+    }
+    std::vector<int> local_ids(MAX_SYMBOLS, -1);
+    std::vector<Tick> batch(MAX_BATCH);
+    std::vector<BridgeSymbol> symbols(MAX_SYMBOLS);
+    bool started = false;
+    uint64_t expected = 0;
+
+    while (recv_all(fd, &frame, sizeof(frame))) {
+        if (frame.magic != BRIDGE_MAGIC) {
+            std::cerr << "Error: lost frame alignment with the sender.\n";
+            return false;
+        }
+        if (frame.type == BRIDGE_SYMBOLS) {
+            if (frame.record_size != sizeof(BridgeSymbol) || frame.count > MAX_SYMBOLS ||
+                !recv_all(fd, symbols.data(), frame.count * sizeof(BridgeSymbol))) {
+                return false;
+            }
+            for (uint32_t i = 0; i < frame.count; i++) {
+                symbols[i].name[SYMBOL_NAME_SIZE - 1] = '\0';
+                if (symbols[i].id < MAX_SYMBOLS) {
+                    local_ids[symbols[i].id] = symbol_register(shared_buffer, symbols[i].name);
+                }
+            }
+            continue;
+        }
+        if (frame.type != BRIDGE_TICKS || frame.record_size != sizeof(Tick) || frame.count > MAX_BATCH ||
+            !recv_all(fd, batch.data(), frame.count * sizeof(Tick))) {
+            return false;
+        }
+        if (started && frame.position > expected) {
+            skipped += frame.position - expected;
+        }
+        started = true;
+        expected = frame.position + frame.count;
+
+        int n = 0;
+        for (uint32_t i = 0; i < frame.count; i++) {
+            int id = batch[i].comm_index < MAX_SYMBOLS ? local_ids[batch[i].comm_index] : -1;
+            if (id != -1) {
+                batch[n] = batch[i];
+                batch[n].comm_index = (uint16_t)id;
+                n++;
+            }
+        }
+        unregistered += frame.count - n;
+        publish_ticks(shared_buffer, batch.data(), n, metrics);
+        frames++;
+        ticks += n;
+    }
+    return true;
+}
+
+int run_receiver(int listen_fd) {
+    producer_entry = producer_register(shared_buffer);
+    metrics = producer_metrics(shared_buffer, producer_entry);
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to accept a sender");
+            return 1;
+        }
+        printf("Sender connected.\n");
+        bool ok = receive_connection(fd);
+        close(fd);
+        printf("Sender %s after %llu ticks.\n", ok ? "disconnected" : "dropped", (unsigned long long)ticks);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || (strcmp(argv[1], "send") != 0 && strcmp(argv[1], "recv") != 0)) {
+        std::cerr << "Error not enough arguments passed.\n"
+                     "Usage: ./bridge send ADDRESS [--lossy] [--batch N] [--zerocopy] [--shm NAME] [--hugepages]\n"
+                     "       ./bridge recv ADDRESS [--shm NAME] [--hugepages]\n"
+                     "       (ADDRESS: unix:PATH or tcp:HOST:PORT, recv also tcp:PORT)\n";
+        return 1;
+    }
+    sending = strcmp(argv[1], "send") == 0;
+    std::string address = argv[2];
+    bool lossy = false;
+    bool zerocopy = false;
+    int batch_size = MAX_BATCH;
+    ShmOptions shm_options;
+    for (int i = 3; i < argc; ) {
+        int used = shm_parse_option(shm_options, argc, argv, i);
+        if (used > 0) {
+            i += used;
+            continue;
+        }
+        if (strcmp(argv[i], "--lossy") == 0 && sending) {
+            lossy = true;
+        } else if (strcmp(argv[i], "--zerocopy") == 0 && sending) {
+            zerocopy = true;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc && sending) {
+            batch_size = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Error unknown option " << argv[i] << ".\n";
+            return 1;
+        }
+        i++;
+    }
+    if (batch_size < 1 || batch_size > MAX_BATCH) {
+        std::cerr << "Error Invalid batch size, must be between 1 and " << MAX_BATCH << ".\n";
+        return 1;
+    }
+
+    signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);
+    if (!shm_attach(shm_options, segment)) {
+        return 1;
+    }
+    shared_buffer = (SharedBuffer*)segment.addr;
+    const char* layout_error = header_check(shared_buffer, segment.size);
+    if (layout_error) {
+        std::cerr << "Error: " << layout_error << ".\n";
+        return 1;
+    }
+    if (sending && shared_buffer->header.transport != TRANSPORT_BROADCAST) {
+        std::cerr << "Error: the sender reads the ring next to the consumer, start the consumer with broadcast.\n";
+        return 1;
+    }
+    wait_set_strategy(WAIT_ADAPTIVE);
+
+    bool tcp;
+    int fd = socket_open(address, !sending, tcp, unix_path);
+    if (fd == -1) {
+        return 1;
+    }
+    printf("%s %s.\n", sending ? "Sending to" : "Receiving on", address.c_str());
+    return sending ? run_sender(fd, tcp, lossy, std::min(batch_size, shared_buffer->header.buffer_size), zerocopy)
+                   : run_receiver(fd);
+}
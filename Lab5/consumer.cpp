@@ -9,113 +9,197 @@
 #include <cstdlib>
 #include <csignal>
 #include <vector> 
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <cerrno>
+#include <cmath>
+
+#include "shared_buffer.h"
+#include "ring_buffer.h"
+#include "shm_backend.h"
+#include "rolling_stats.h"
+#include "latency_histogram.h"
+#include "journal.h"
+#include "cpu_affinity.h"
+#include <sys/resource.h>
+
+#define DEFAULT_FPS 30
+#define MAX_FPS 240
 
-#define MAX_COMMODITIES 11
-#define Max_Buffer_size 40
-
-
-
-// Structure for shared memory
-struct SharedBuffer {
-    double prices[MAX_COMMODITIES][5] ;       // Current prices
-    int write_index[MAX_COMMODITIES];          // Write index for circular buffer to allow continous addition of prices. represent the next avaialable index to be written in.                        
-    double buffer_prices[Max_Buffer_size];      // Pointer to array for prices (inside shared memory)
-    double buffer_comm_index[Max_Buffer_size];  // Pointer to array for commodity indexes (inside shared memory)
-    int front;               // Front of the queue
-    int rear;                // Rear of the queue
-    int count;               // Number of elements in the buffer
-    int buffer_size;         // Buffer size
-};
 // Initialize the buffer inside shared memory
-void initBuffer(SharedBuffer* sb, int buffer_size) {
+void initBuffer(SharedBuffer* sb) {
     sb->front = 0;
     sb->rear = 0;
     sb->count = 0;
-    sb->buffer_size = buffer_size;
-}
-
-// Push values into the buffer
-void push(SharedBuffer* sb, int price, int comm_index) {
-    if (sb->count < sb->buffer_size) {
-        sb->buffer_prices[sb->rear] = price;
-        sb->buffer_comm_index[sb->rear] = comm_index;
-        sb->rear = (sb->rear + 1) % sb->buffer_size;  // Wrap around
-        sb->count++;
-    } else {
-        std::cerr << "Buffer is full! Cannot push.\n";
-    }
 }
 
 // Pop values from the buffer
-void pop(SharedBuffer* sb, int& price, int& comm_index) {
+void pop(SharedBuffer* sb, Tick& tick) {
     if (sb->count > 0) {
-        price = sb->buffer_prices[sb->front];
-        comm_index = sb->buffer_comm_index[sb->front];
-        sb->front = (sb->front + 1) % sb->buffer_size;  // Wrap around
+        tick = buffer_ticks(sb)[sb->front];
+        sb->front = (sb->front + 1) & sb->header.mask;  // Wrap around
         sb->count--;
     } else {
         std::cerr << "Buffer is empty! Cannot pop.\n";
     }
 }
-int shm_id;
+// Pop up to max values from the buffer in one pass. Returns how many were popped.
+int pop_batch(SharedBuffer* sb, Tick ticks[], int max) {
+    int n = 0;
+    while (n < max && sb->count > 0) {
+        ticks[n] = buffer_ticks(sb)[sb->front];
+        sb->front = (sb->front + 1) & sb->header.mask;  // Wrap around
+        sb->count--;
+        n++;
+    }
+    return n;
+}
+ShmSegment segment;
 SharedBuffer *shared_buffer = nullptr;
-int sem_mutex_id = 0;
-int sem_filled_id = 0;
-int sem_available_id = 0;
-
-void handle_sigint(int sig) {
-    if (shared_buffer) {
-        // Detach from shared memory
-        if (shmdt(shared_buffer) == -1) {
-            perror("Failed to detach shared memory");
+int sem_mutex_id = -1;
+int sem_filled_id = -1;
+int sem_available_id = -1;
+ReaderCursor *reader = nullptr;    // Our cursor on a broadcast ring
+bool attach = false;               // Attached to another consumer's broadcast ring, which owns the IPC objects
+bool view = false;                 // Only showing the last-value cache (--view), nothing is dequeued
+uint64_t skipped_ticks = 0;        // Ticks a lossy reader missed because producers lapped it
+
+// Latency histograms in microseconds, per symbol. Allocated for a symbol when its first tick arrives,
+// thousands of mostly idle symbols would otherwise cost 21KB each.
+struct SymbolLatency {
+    LatencyHistogram enqueue_wait;      // Generation to enqueue: the producer's semaphore waits, or its waits for ring room (from Tick::enqueue_lag)
+    LatencyHistogram queue_latency;     // Enqueue to dequeue (drain thread)
+    LatencyHistogram end_to_end;        // Generation to statistics updated (compute thread)
+};
+std::atomic<SymbolLatency*> symbol_latency[MAX_SYMBOLS];
+LatencyHistogram consumer_lock_wait;                // The consumer waiting for the mutex (drain thread)
+LatencyHistogram all_queue_latency;                 // queue_latency of every commodity together
+LatencyHistogram all_end_to_end;                    // end_to_end of every commodity together
+FILE* latency_file = stderr;                        // Where latency reports go (--latency-file)
+int latency_interval = 0;                           // Seconds between reports, 0 for only on SIGUSR1 and exit
+volatile sig_atomic_t latency_report_requested = 0;
+
+void print_latency_report(FILE* out);
+
+// Histograms of a symbol, created by whichever stage records for it first
+SymbolLatency& latency_of(int id) {
+    SymbolLatency* latency = symbol_latency[id].load(std::memory_order_acquire);
+    if (!latency) {
+        SymbolLatency* created = new SymbolLatency();
+        if (symbol_latency[id].compare_exchange_strong(latency, created)) {
+            latency = created;
         } else {
-            printf("Shared memory detached successfully.\n");
+            delete created;
         }
     }
+    return *latency;
+}
 
-    // Remove shared memory (only in consumer to avoid producers deleting it)
-    if (shmctl(shm_id, IPC_RMID, nullptr) == -1) {
-        perror("Failed to delete shared memory");
-    } else {
-        printf("Shared memory deleted successfully.\n");
+// Every dequeued tick appended to disk (--journal), by the drain thread
+JournalWriter journal;
+const char* journal_dir = nullptr;
+
+// Benchmark summary (--report), written on exit
+const char* bench_report_path = nullptr;
+uint64_t ticks_consumed = 0;                                // Counted by the drain thread
+std::chrono::steady_clock::time_point first_tick_time;      // When the first tick was dequeued
+
+// One line of key=value pairs for the benchmark driver
+void write_bench_report() {
+    FILE* out = fopen(bench_report_path, "w");
+    if (!out) {
+        perror("Failed to open the benchmark report");
+        return;
     }
+    double seconds = 0;
+    if (ticks_consumed > 0) {
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - first_tick_time).count();
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "ticks=%llu seconds=%.6f ticks_per_sec=%.0f queue_p50=%llu queue_p99=%llu queue_p999=%llu "
+                 "e2e_p50=%llu e2e_p99=%llu e2e_p999=%llu e2e_max=%llu lock_wait_p99=%llu skipped=%llu "
+                 "voluntary_cs=%ld involuntary_cs=%ld spun_waits=%llu yielded_waits=%llu blocked_waits=%llu\n",
+            (unsigned long long)ticks_consumed, seconds, seconds > 0 ? ticks_consumed / seconds : 0.0,
+            (unsigned long long)all_queue_latency.percentile(0.50), (unsigned long long)all_queue_latency.percentile(0.99),
+            (unsigned long long)all_queue_latency.percentile(0.999),
+            (unsigned long long)all_end_to_end.percentile(0.50), (unsigned long long)all_end_to_end.percentile(0.99),
+            (unsigned long long)all_end_to_end.percentile(0.999), (unsigned long long)all_end_to_end.max(),
+            (unsigned long long)consumer_lock_wait.percentile(0.99), (unsigned long long)skipped_ticks,
+            usage.ru_nvcsw, usage.ru_nivcsw, (unsigned long long)wait_counters().spun.load(),
+            (unsigned long long)wait_counters().yielded.load(), (unsigned long long)wait_counters().blocked.load());
+    fclose(out);
+}
+
 
-    if (sem_mutex_id != 0 || sem_filled_id != 0 || sem_available_id != 0) {
-        if (semctl(sem_mutex_id, 0, IPC_RMID) == -1) {
+// SIGINT and SIGALRM (--duration) only ask every loop and wait to stop, main shuts down once they have
+void handle_sigint(int sig) {
+    (void)sig;
+    wait_request_stop();
+}
+
+// Run from main after the pipeline threads returned: reports, then the segment is left or removed.
+// Returns the exit status.
+int shutdown() {
+    if (view) {
+        shm_detach(segment);
+        return 0;
+    }
+    if (bench_report_path) {
+        write_bench_report();
+    }
+    print_latency_report(latency_file);
+    if (journal_dir) {
+        journal.sync();
+        printf("Journaled %llu ticks to %s (last segment %d).\n", (unsigned long long)journal.appended(), journal_dir, journal.segment());
+    }
+    if (reader && skipped_ticks > 0) {
+        printf("Lossy reader skipped %llu ticks.\n", (unsigned long long)skipped_ticks);
+    }
+    if (attach) {
+        // Leave the IPC objects to the consumer that created them
+        broadcast_unregister(shared_buffer, reader);
+        shm_detach(segment);
+        return 0;
+    }
+    // Producers or other readers still running: removing the segment from under them would strand them,
+    // so it stays (with its semaphores and our broadcast cursor) for the next consumer to reattach
+    int users = live_users(shared_buffer, getpid());
+    if (users > 0 || shm_attach_count(segment) > 1) {
+        printf("Shared buffer still in use by %d other processes, left for the next consumer to reattach (./consumer --reset removes it).\n",
+               users > 0 ? users : shm_attach_count(segment) - 1);
+        shm_detach(segment);
+        return 0;
+    }
+
+    // Detach from shared memory
+    shm_detach(segment);
+
+    // Remove shared memory (only in consumer to avoid producers deleting it)
+    shm_remove(segment);
+
+    if (sem_mutex_id != -1 && semctl(sem_mutex_id, 0, IPC_RMID) == -1) {
         perror("Removing the mutex semaphore failed");
-        exit(EXIT_FAILURE);
+        return 1;
     }
-    if (semctl(sem_available_id, 0, IPC_RMID) == -1) {
+    if (sem_available_id != -1 && semctl(sem_available_id, 0, IPC_RMID) == -1) {
         perror("Removing the available semaphore failed");
-        exit(EXIT_FAILURE);
+        return 1;
     }
-    if (semctl(sem_filled_id, 0, IPC_RMID) == -1) {
+    if (sem_filled_id != -1 && semctl(sem_filled_id, 0, IPC_RMID) == -1) {
         perror("Removing the filled semaphore failed");
-        exit(EXIT_FAILURE);
+        return 1;
     }
-
     printf("Semaphores removed successfully.\n");
-        
-    }
 
-    exit(0); // Terminate program
+    return 0;
 }
 
- // Define the commodity names
-const char* predefined_commodities[MAX_COMMODITIES] = {
-    "ALUMINIUM",
-    "COPPER",
-    "COTTON",
-    "CRUDEOIL",
-    "GOLD",
-    "LEAD",
-    "MENTHAOIL",
-    "NATURAL_GAS",
-    "NICKEL",
-    "SILVER",
-    "ZINC"
-};
-
 // Union for semaphore control
 union semun {
     int val;               // Value for SETVAL
@@ -123,251 +207,808 @@ union semun {
     unsigned short *array; // Array for GETALL, SETALL
 };
 
-// Decrease the semaphore value 
-void semWait(int semid) {
-    struct sembuf sop = {0, -1, 0};
-    if (semop(semid, &sop, 1) == -1) {
-        perror("semWait failed");
-        exit(EXIT_FAILURE);
-    }
+// Ask the render thread for a latency report
+void handle_sigusr1(int sig) {
+    (void)sig;
+    latency_report_requested = 1;
 }
 
-// Increase the semaphore value 
-void semSignal(int semid) {
-    struct sembuf sop = {0, 1, 0};
-    if (semop(semid, &sop, 1) == -1) {
-        perror("semSignal failed");
-        exit(EXIT_FAILURE);
+void print_histogram_row(FILE* out, const char* name, const char* metric, const LatencyHistogram& h) {
+    if (h.count() == 0) {
+        return;
     }
+    fprintf(out, "%12s %-12s %10llu %9llu %9llu %9llu %9llu\n", name, metric, (unsigned long long)h.count(),
+            (unsigned long long)h.percentile(0.50), (unsigned long long)h.percentile(0.99),
+            (unsigned long long)h.percentile(0.999), (unsigned long long)h.max());
 }
 
-std :: string prev_price_color[MAX_COMMODITIES] = {""};
-std :: string prev_price_arrow[MAX_COMMODITIES] = {" "};
-std :: string prev_avg_color[MAX_COMMODITIES] = {""};
-std :: string prev_avg_arrow[MAX_COMMODITIES] = {" "};
-
-void display_dashboard(double current_prices[], double current_avg[], double prev_price[], double prev_avg[]) {
-    // Clear screen
-    printf("\e[1;1H\e[2J");
-
-    std::cout << "Commodity Dashboard\n";
-    std::cout << "==================================================\n";
-    std::cout << std::setw(16) << "CURRENCY" << std::setw(13) << "PRICE" << std::setw(22) << "AVERAGE PRICE" << "\n";
-
-    for (int i = 0; i < MAX_COMMODITIES; i++) {
-         std::cout << std::setw(12) << std::right << predefined_commodities[i] << ": " << std::fixed << std::setprecision(2);
-          if (current_prices[i] < prev_price[i]) {
-                    std::cout << "\033[1;31m" << std::setw(15) << current_prices[i] << "\u2193" << "\033[0m";
-                    prev_price_color[i] = "\033[1;31m";
-                    prev_price_arrow[i] = "\u2193";
-                } else if (current_prices[i] > prev_price[i]) {
-                    std::cout << "\033[1;32m" << std::setw(15) << current_prices[i] << "\u2191" <<"\033[0m";
-                    prev_price_color[i] = "\033[1;32m";
-                    prev_price_arrow[i] = "\u2191";
-                } else {
-                    std::cout << prev_price_color[i] << std::setw(15) << current_prices[i] << std::setw(1) << prev_price_arrow[i] <<"\033[0m";
-                }
-
-                std::cout << std::fixed << std::setprecision(2);
-
-                if (current_avg[i] < prev_avg[i]) {
-                    std::cout << "\033[1;31m" << std::setw(14) << current_avg[i] << "\u2193" << "\033[0m";
-                    prev_avg_color[i] = "\033[1;31m";
-                    prev_avg_arrow[i] = "\u2193";
-                } else if (current_avg[i] > prev_avg[i]) {
-                    std::cout << "\033[1;32m" << std::setw(14) << current_avg[i] << "\u2191" << "\033[0m";
-                    prev_avg_color[i] = "\033[1;32m";
-                    prev_avg_arrow[i] = "\u2191";
-                } else {
-                     std::cout << prev_avg_color[i] << std::setw(14) << current_avg[i] << prev_avg_arrow[i] <<"\033[0m";
-                }
-                 
-                // std::cout << std::setw(15) << std::fixed << std::setprecision(2);
-
-                std::cout << "\n";
-        
+// p50/p99/p99.9/max of every histogram that has samples
+void print_latency_report(FILE* out) {
+    // Producers only wait on a lock with the semaphore transport, the rings make them wait for room
+    const char* enqueue_stage = shared_buffer->header.transport == TRANSPORT_SEMAPHORE ? "lock wait" : "enqueue wait";
+    fprintf(out, "Latency (us)\n%12s %-12s %10s %9s %9s %9s %9s\n", "COMMODITY", "STAGE", "COUNT", "P50", "P99", "P99.9", "MAX");
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        const SymbolLatency* latency = symbol_latency[i].load(std::memory_order_acquire);
+        if (latency) {
+            const char* name = symbol_name(&shared_buffer->symbols, i);
+            print_histogram_row(out, name, enqueue_stage, latency->enqueue_wait);
+            print_histogram_row(out, name, "queue", latency->queue_latency);
+            print_histogram_row(out, name, "end to end", latency->end_to_end);
+        }
     }
+    print_histogram_row(out, "consumer", "lock wait", consumer_lock_wait);
+    fflush(out);
 }
 
-// ===========================================================================================
-// Main function
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cerr << "Error not enough arguments sent.\nUsage: ./consumer <BUFFER_SIZE>\n";
-        return 1;
+// One dashboard row. Written by the compute thread, copied out by the render thread.
+struct DashboardRow {
+    double price;
+    double prev_price;
+    double avg;
+    double prev_avg;
+    double ewma;
+    double stddev;
+    double min;
+    double max;
+    double twap;
+};
+
+DashboardRow dashboard[MAX_SYMBOLS] = {};      // By symbol id, the registered ones are shown
+std::mutex dashboard_mutex;     // Guards dashboard, never held while waiting on the producers
+
+// Ticks handed from the drain thread to the compute thread. Its sync policy is a build option (make variants),
+// the shared buffer's transport is not affected by it.
+#ifndef PIPELINE_SYNC
+#define PIPELINE_SYNC LockFreeSync
+#endif
+#define PIPELINE_SIZE (1 << 16)
+RingBuffer<Tick, PIPELINE_SIZE, PIPELINE_SYNC> pipeline;
+
+std :: string prev_price_color[MAX_SYMBOLS] = {""};
+std :: string prev_price_arrow[MAX_SYMBOLS] = {" "};
+std :: string prev_avg_color[MAX_SYMBOLS] = {""};
+std :: string prev_avg_arrow[MAX_SYMBOLS] = {" "};
+
+// A statistic for the dashboard, "-" for one the source doesn't have (NaN)
+std::string stat_text(double value) {
+    if (std::isnan(value)) {
+        return "-";
     }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << value;
+    return out.str();
+}
 
-    signal(SIGINT, handle_sigint); // listen for termination process and calls handle_siginit dunction.
-    int buffer_size = std::stoi(argv[1]);
-    if (buffer_size >= Max_Buffer_size){
-        perror("Invalid Buffer size, buffer size entered is greater than the Max Buffer size");
-        return 1;
+// Rows from the last-value cache (--view). Arrows compare with the previous snapshot. The cache
+// keeps no window, so there is no standard deviation or TWAP, and the average is of every price.
+void snapshot_rows(DashboardRow rows[], int count) {
+    for (int i = 0; i < count; i++) {
+        LastValue value;
+        if (!lvc_snapshot(shared_buffer->last_values[i], value) || value.updates == 0) {
+            continue;       // Being rewritten on every try, or nothing yet: keep the last row
+        }
+        DashboardRow& row = rows[i];
+        row.prev_price = row.price;
+        row.price = value.price;
+        row.prev_avg = row.avg;
+        row.avg = value.mean;
+        row.ewma = value.ewma;
+        row.stddev = NAN;
+        row.min = value.min;
+        row.max = value.max;
+        row.twap = NAN;
     }
-   
+}
 
-    // Generate unique key for shared memory 
-    key_t sharedm_key = ftok("consumer", 65);
-    if (sharedm_key == -1) {
-        perror("Failed to generate shared memory key in the consumer.");
-        return 1;
+// Format the dashboard into lines, one per screen row
+void display_dashboard(const DashboardRow rows[], int count, const std::string& title, std::vector<std::string>& lines) {
+    lines.clear();
+    std::ostringstream out;
+    out << title;
+    lines.push_back(out.str());
+    lines.push_back("==============================================================================================================");
+    out.str("");
+    out << std::setw(16) << "CURRENCY" << std::setw(13) << "PRICE" << std::setw(22) << "AVERAGE PRICE"
+        << std::setw(12) << "EWMA" << std::setw(12) << "STD DEV" << std::setw(12) << "MIN" << std::setw(12) << "MAX" << std::setw(12) << "TWAP";
+    lines.push_back(out.str());
+
+    for (int i = 0; i < count; i++) {
+        const DashboardRow& row = rows[i];
+        out.str("");
+        out << std::setw(12) << std::right << symbol_name(&shared_buffer->symbols, i) << ": " << std::fixed << std::setprecision(2);
+        if (row.price < row.prev_price) {
+            out << "\033[1;31m" << std::setw(15) << row.price << "\u2193" << "\033[0m";
+            prev_price_color[i] = "\033[1;31m";
+            prev_price_arrow[i] = "\u2193";
+        } else if (row.price > row.prev_price) {
+            out << "\033[1;32m" << std::setw(15) << row.price << "\u2191" << "\033[0m";
+            prev_price_color[i] = "\033[1;32m";
+            prev_price_arrow[i] = "\u2191";
+        } else {
+            out << prev_price_color[i] << std::setw(15) << row.price << std::setw(1) << prev_price_arrow[i] << "\033[0m";
+        }
+
+        if (row.avg < row.prev_avg) {
+            out << "\033[1;31m" << std::setw(14) << row.avg << "\u2193" << "\033[0m";
+            prev_avg_color[i] = "\033[1;31m";
+            prev_avg_arrow[i] = "\u2193";
+        } else if (row.avg > row.prev_avg) {
+            out << "\033[1;32m" << std::setw(14) << row.avg << "\u2191" << "\033[0m";
+            prev_avg_color[i] = "\033[1;32m";
+            prev_avg_arrow[i] = "\u2191";
+        } else {
+            out << prev_avg_color[i] << std::setw(14) << row.avg << prev_avg_arrow[i] << "\033[0m";
+        }
+
+        out << std::setw(12) << row.ewma << std::setw(12) << stat_text(row.stddev) << std::setw(12) << row.min
+            << std::setw(12) << row.max << std::setw(12) << stat_text(row.twap);
+        lines.push_back(out.str());
     }
+}
 
-    // Create shared memory
-    shm_id = shmget(sharedm_key, sizeof(SharedBuffer), 0666 | IPC_CREAT | IPC_EXCL);
-    if (shm_id == -1) {
-    if (errno == EEXIST) {
-        std::cerr << "Shared memory already exists. Ensure no conflicting memory segments are present.\n";
-        std::cerr << "Shared memory id: " << shm_id << " \n";
-        shmctl(shm_id, IPC_RMID, nullptr);
+// Write the whole buffer, retrying on short writes
+void write_all(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        done += n;
     }
-    perror("Shared memory creation failed");
-    return 1;
+}
+
+// Compute stage: takes ticks off the pipeline, updates the rolling statistics and publishes the rows
+void compute_loop(int window) {
+    // By symbol id, a window is only allocated when the id's first tick arrives: a full window is
+    // 2 * window doubles, too much to hold for every id up to the highest one seen
+    std::vector<std::unique_ptr<RollingStats>> stats(MAX_SYMBOLS);
+    std::vector<DashboardRow> rows(MAX_SYMBOLS);
+    std::vector<Tick> ticks(MAX_BATCH);
+    int used = 0;                               // Rows up to the highest id seen
+
+    while (!wait_stopping()) {
+        int n = pipeline.pop_batch(ticks.data(), MAX_BATCH);
+        uint32_t now = monotonic_us();
+        for (int i = 0; i < n; i++) {
+            int comm_index = ticks[i].comm_index;
+            if (!stats[comm_index]) {
+                stats[comm_index].reset(new RollingStats(window));
+                used = std::max(used, comm_index + 1);
+            }
+            RollingStats& st = *stats[comm_index];
+            st.add(ticks[i].price, ticks[i].ts_us);
+            latency_of(comm_index).end_to_end.record((uint32_t)(now - ticks[i].ts_us));
+            all_end_to_end.record((uint32_t)(now - ticks[i].ts_us));
+
+            // Store the last price and average price of each commodity
+            DashboardRow& row = rows[comm_index];
+            row.prev_price = row.price;
+            row.price = st.last();
+            row.prev_avg = row.avg;
+            row.avg = st.mean();
+            row.ewma = st.ewma();
+            row.stddev = st.stddev();
+            row.min = st.min();
+            row.max = st.max();
+            row.twap = st.twap();
+        }
+
+        std::lock_guard<std::mutex> lock(dashboard_mutex);
+        memcpy(dashboard, rows.data(), used * sizeof(DashboardRow));
     }
-    else {
-    std::cout << "Shared memory id: " << shm_id << " \n";
+}
+
+// Render stage: redraws at a fixed frame rate, rewriting only the lines that changed, in a single write()
+void render_loop(int window, int fps) {
+    std::vector<std::string> lines;
+    std::vector<std::string> shown;     // What is on the screen now
+    std::string frame;
+    std::vector<DashboardRow> rows(MAX_SYMBOLS);
+    std::string title = view ? "Commodity Dashboard (last values)" : "Commodity Dashboard (window " + std::to_string(window) + ")";
+    std::chrono::steady_clock::duration period = std::chrono::microseconds(1000000 / fps);
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_report = next + std::chrono::seconds(latency_interval);
+
+    while (!wait_stopping()) {
+        int count = (int)shared_buffer->symbols.count.load(std::memory_order_acquire);
+        if (view) {
+            snapshot_rows(rows.data(), count);
+        } else {
+            std::lock_guard<std::mutex> lock(dashboard_mutex);
+            memcpy(rows.data(), dashboard, count * sizeof(DashboardRow));
+        }
+        display_dashboard(rows.data(), count, title, lines);
+
+        frame.clear();
+        if (shown.empty()) {
+            frame = "\033[1;1H\033[2J";   // Clear the screen once, then only touch changed lines
+        }
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (i < shown.size() && shown[i] == lines[i]) {
+                continue;
+            }
+            frame += "\033[" + std::to_string(i + 1) + ";1H" + lines[i] + "\033[K";
+        }
+        if (!frame.empty()) {
+            frame += "\033[" + std::to_string(lines.size() + 1) + ";1H";    // Park the cursor under the table
+            write_all(STDOUT_FILENO, frame);
+            shown = lines;
+        }
+
+        if (!view && (latency_report_requested || (latency_interval > 0 && next >= next_report))) {
+            latency_report_requested = 0;
+            next_report = next + std::chrono::seconds(latency_interval);
+            print_latency_report(latency_file);
+        }
+
+        next += period;
+        std::this_thread::sleep_until(next);
     }
+}
 
-    shared_buffer = (SharedBuffer *)shmat(shm_id, nullptr, 0);    
-    if (shared_buffer == (void *)-1) {
-        perror("Shared memory attachment failed in consumer.");
-        shmdt(shared_buffer);
-        return 1;
+// Take over the transport of a segment whose consumer died, keeping the ticks still queued in it.
+// Returns false after printing the error.
+bool reattach_transport(int previous_owner, bool lossy) {
+    SharedHeader& header = shared_buffer->header;
+    uint64_t queued = 0;
+    lvc_repair(shared_buffer);
+    if (header.transport == TRANSPORT_SEMAPHORE) {
+        // The dead consumer may have claimed filled units without popping their ticks, or popped ticks
+        // without giving their room back. Producers signal filled before releasing the mutex, so under
+        // it both semaphores can be set from the queue's count. (A producer that already took room and
+        // waits for the mutex still pushes on top; push() refuses what doesn't fit.)
+        if (!semLock(sem_mutex_id)) {
+            return false;
+        }
+        queued = shared_buffer->count;
+        union semun value;
+        value.val = shared_buffer->count;
+        bool set = semctl(sem_filled_id, 0, SETVAL, value) != -1;
+        value.val = header.buffer_size - shared_buffer->count;
+        set = set && semctl(sem_available_id, 0, SETVAL, value) != -1;
+        semUnlock(sem_mutex_id);
+        if (!set) {
+            perror("Resetting the filled and available semaphores failed");
+            return false;
+        }
+    } else if (header.transport == TRANSPORT_BROADCAST) {
+        // Continue from the dead owner's cursor, and stop gating producers on other dead readers.
+        // Producers that found the ring full may already have freed the owner's cursor, then this
+        // reader starts at the tail. Taking it over goes through lossy, so they can't free it meanwhile.
+        for (int i = 0; i < MAX_READERS; i++) {
+            ReaderCursor* cursor = &shared_buffer->readers[i];
+            uint32_t state = cursor->state.load();
+            if (state == READER_FREE) {
+                continue;
+            }
+            if (cursor->pid == previous_owner && !reader && cursor->state.compare_exchange_strong(state, READER_LOSSY)) {
+                reader = cursor;
+                cursor->pid = getpid();
+                cursor->state.store(lossy ? READER_LOSSY : READER_GATING);
+            } else if (!pid_alive(cursor->pid)) {
+                broadcast_unregister(shared_buffer, cursor);
+            }
+        }
+        if (!reader) {
+            reader = broadcast_register(shared_buffer, lossy);
+        }
+        if (!reader) {
+            std::cerr << "Error: all " << MAX_READERS << " reader cursors are in use.\n";
+            return false;
+        }
+        // The cursor we took over may have been a lossy one further behind, producers must rescan
+        shared_buffer->reader_gate.store(0);
+        queued = shared_buffer->ring.tail.load() - reader->position.load();
+    } else if (header.transport == TRANSPORT_LOCKFREE) {
+        // Nobody sleeps on not_empty any more, whatever the dead consumer left in the counter
+        shared_buffer->ring.not_empty.waiters.store(0);
+        queued = shared_buffer->ring.tail.load() - shared_buffer->ring.head.load();
+    } else {
+        shared_buffer->shard_doorbell.waiters.store(0);
+        for (int i = 0; i < SHARD_COUNT; i++) {
+            queued += shared_buffer->shards[i].tail.load() - shared_buffer->shards[i].head.load();
+        }
     }
+    printf("Reattached to the shared buffer of consumer %d, %llu ticks still queued.\n", previous_owner, (unsigned long long)queued);
+    return true;
+}
 
-   // Initialize the buffer pointers
-    initBuffer(shared_buffer, buffer_size);
+// A segment is already there. Reattach if its consumer died and it still works (the ring and the
+// producers carry on), remove it if it is unusable or reset is set. Refuses while its consumer runs,
+// and removes an unusable segment only if nobody uses it.
+// Returns false after printing the error, reattached tells whether the segment is ours now.
+bool recover_ipc(const ShmOptions& shm_options, bool reset, bool lossy, bool& reattached) {
+    reattached = false;
+    ShmSegment old;
+    if (!shm_attach(shm_options, old)) {
+        return false;
+    }
+    SharedBuffer* sb = (SharedBuffer*)old.addr;
+    const char* layout_error = header_check(sb, old.size);
+    int owner = layout_error ? 0 : sb->header.owner_pid;
+    if (owner != getpid() && pid_alive(owner)) {
+        std::cerr << "Error: consumer " << owner << " is still running on this shared buffer.\n";
+        shm_detach(old);
+        return false;
+    }
+    const char* stale = layout_error;
+    if (!stale && (semctl(sb->header.sem_mutex_id, 0, GETVAL) == -1 || semctl(sb->header.sem_filled_id, 0, GETVAL) == -1 ||
+                   semctl(sb->header.sem_available_id, 0, GETVAL) == -1)) {
+        stale = "its semaphores are gone";
+    }
+    if (!stale && !reset) {
+        segment = old;
+        shared_buffer = sb;
+        sem_mutex_id = sb->header.sem_mutex_id;
+        sem_filled_id = sb->header.sem_filled_id;
+        sem_available_id = sb->header.sem_available_id;
+        sb->header.owner_pid = getpid();
+        reattached = true;
+        return reattach_transport(owner, lossy);
+    }
 
-    // Initialize the write index array with 0
-    memset(shared_buffer->write_index, 0, sizeof(shared_buffer->write_index));
-    // Initialize the prices array with 0 
-    memset(shared_buffer->prices, 0, sizeof(shared_buffer->prices));
-    memset(shared_buffer->buffer_comm_index, 0, sizeof(shared_buffer->buffer_comm_index));
-    memset(shared_buffer->buffer_prices, 0, sizeof(shared_buffer->buffer_prices));
-  
+    int users = layout_error ? shm_attach_count(old) - 1 : live_users(sb, getpid());
+    if (stale && !reset && users > 0) {
+        std::cerr << "Error: the existing shared buffer can't be reused (" << stale << ") but " << users
+                  << " processes still use it. Stop them, or remove it with --reset.\n";
+        shm_detach(old);
+        return false;
+    }
+    if (stale) {
+        printf("Removing the existing shared buffer (%s).\n", stale);
+    }
+    if (!layout_error) {
+        // Leftover semaphores of the old segment; already removed ones just fail
+        semctl(sb->header.sem_mutex_id, 0, IPC_RMID);
+        semctl(sb->header.sem_filled_id, 0, IPC_RMID);
+        semctl(sb->header.sem_available_id, 0, IPC_RMID);
+    }
+    shm_detach(old);
+    shm_remove(old);
+    return true;
+}
 
-    // Generate unique keys for sempahores
-    key_t sem_mutex_key = ftok("consumer", 70);
-     if (sem_mutex_key == -1) {
-        perror("Failed to generate a semaphore (mutex) key in the consumer.");
-        return 1;
+// Create the shared memory and the semaphores, and initialize the buffer for transport.
+// A segment left behind by a consumer that died is reattached instead (or removed with reset).
+bool create_ipc(const ShmOptions& shm_options, int buffer_size, int transport, bool lossy, bool reset) {
+    if (shm_exists(shm_options)) {
+        bool reattached;
+        if (!recover_ipc(shm_options, reset, lossy, reattached)) {
+            return false;
+        }
+        if (reattached) {
+            return true;
+        }
     }
-    
-    key_t sem_filled_key = ftok("consumer", 71);
-     if (sem_filled_key == -1) {
-        perror("Failed to generate a semaphore (filled) key in the consumer.");
-        return 1;
+    // Create and attach the shared memory
+    if (!shm_create(shm_options, shared_buffer_size(transport, buffer_size), segment)) {
+        return false;
     }
-    
-    key_t sem_available_key = ftok("consumer", 72);
-     if (sem_available_key == -1) {
-        perror("Failed to generate a semaphore (available) key in the consumer.");
-        return 1;
+    shared_buffer = (SharedBuffer *)segment.addr;
+    std::cout << "Shared memory backend: " << shm_describe(shm_options) << ", " << segment.size << " bytes\n";
+
+   // Initialize the header (sizes and offsets) and the buffer pointers
+    header_init(shared_buffer, buffer_size, transport);
+    initBuffer(shared_buffer);
+    lvc_init(shared_buffer);
+    symbol_table_init(&shared_buffer->symbols);
+    for (int i = 0; i < DEFAULT_SYMBOL_COUNT; i++) {
+        char name[SYMBOL_NAME_SIZE];
+        symbol_normalize(DEFAULT_SYMBOLS[i], name);
+        symbol_insert(&shared_buffer->symbols, name);
     }
 
+    // Initialize the slots of the chosen transport, they follow the fixed part of the segment
+    RingSlot* slots = reinterpret_cast<RingSlot*>(buffer_ticks(shared_buffer));
+    if (transport == TRANSPORT_SEMAPHORE) {
+        memset(buffer_ticks(shared_buffer), 0, (size_t)buffer_size * sizeof(Tick));
+    } else if (transport == TRANSPORT_LOCKFREE) {
+        ring_init(&shared_buffer->ring, buffer_size, slots);
+    } else if (transport == TRANSPORT_BROADCAST) {
+        broadcast_init(shared_buffer, buffer_size, slots);
+    } else {
+        shards_init(shared_buffer, buffer_size, slots);
+    }
+  
+
     // Create the Mutex semaphore
-    sem_mutex_id = semget(sem_mutex_key, 1, 0666 | IPC_CREAT | IPC_EXCL); 
+    sem_mutex_id = semget(IPC_PRIVATE, 1, 0666); // Private, producers find the id in the header
     if (sem_mutex_id == -1) {
-         if (errno == EEXIST) {
-        std::cerr << "Semaphore already exists.\n";
-        semctl(sem_mutex_id, 0, IPC_RMID); // Remove the semaphore
-         }
         perror("Semaphore creation failed in consumer.");
-        return 1;
+        return false;
     }
     else {std::cerr << "Mutex Semaphore id: " << sem_mutex_id << " \n";}
     union semun sem_union;
     sem_union.val = 1; 
     if (semctl(sem_mutex_id, 0, SETVAL, sem_union) == -1) {  // Mutex semaphore initialized to 1
         perror("semctl for mutex failed");
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     // Create the Availabe semaphore
-    sem_available_id = semget(sem_available_key, 1, 0666 | IPC_CREAT | IPC_EXCL); 
+    sem_available_id = semget(IPC_PRIVATE, 1, 0666); // Private, producers find the id in the header
     if (sem_available_id== -1) {
-         if (errno == EEXIST) {
-        std::cerr << "Semaphore already exists.\n";
-        semctl(sem_available_id, 0, IPC_RMID); // Remove the semaphore
-         }
         perror("Semaphore creation failed in consumer.");
-        return 1;
+        return false;
     }
     else {std::cerr << "Availble Semaphore id: " << sem_available_id << " \n";}
 
-    sem_union.val = buffer_size; 
+    sem_union.val = transport == TRANSPORT_SEMAPHORE ? buffer_size : 0; // Unused by the lock-free transports
     if (semctl(sem_available_id, 0, SETVAL, sem_union) == -1) {  // Available semaphore initialized to buffersize
         perror("semctl for available failed");
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     // Create the filled semaphore
-    sem_filled_id = semget(sem_filled_key, 1, 0666 | IPC_CREAT | IPC_EXCL); 
+    sem_filled_id = semget(IPC_PRIVATE, 1, 0666); // Private, producers find the id in the header
     if (sem_filled_id== -1) {
-         if (errno == EEXIST) {
-        std::cerr << "Semaphore already exists.\n";
-        semctl(sem_filled_id, 0, IPC_RMID); // Remove the semaphore
-         }
         perror("Semaphore creation failed in consumer.");
-        return 1;
+        return false;
     }
     else {std::cerr << "Filled Semaphore id: " << sem_filled_id << " \n";}
 
     sem_union.val = 0; 
     if (semctl(sem_filled_id, 0, SETVAL, sem_union) == -1) {  // Filled semaphore initialized to 0
         perror("semctl for available failed");
-        exit(EXIT_FAILURE);
-    }
-    
-        
-// Initialize the current prices and average prices
-    double current_prices[MAX_COMMODITIES] = {0.00};
-    double current_avg[MAX_COMMODITIES] = {0.00};
-    double prev_price[MAX_COMMODITIES] = {0.00};
-    double prev_avg[MAX_COMMODITIES] = {0.00};
-
-    while (true) {
-        display_dashboard(current_prices, current_avg, prev_price, prev_avg);
-
-        semWait(sem_filled_id); // Wait until at least one producer produces.
-        semWait(sem_mutex_id); // Lock mutex
-        
-    // -------------------------------------Critical Section-------------------------------------
+        return false;
+    }
+
+    shared_buffer->header.sem_mutex_id = sem_mutex_id;
+    shared_buffer->header.sem_filled_id = sem_filled_id;
+    shared_buffer->header.sem_available_id = sem_available_id;
+    // The creating consumer is the first reader of a broadcast ring
+    if (transport == TRANSPORT_BROADCAST) {
+        reader = broadcast_register(shared_buffer, lossy);
+    }
+
+    // Producers refuse to attach until the header is published
+    header_publish(shared_buffer);
+    return true;
+}
+
+// Attach to a broadcast ring created by another consumer and register a cursor on it
+bool attach_ipc(const ShmOptions& shm_options, bool lossy) {
+    if (!shm_attach(shm_options, segment)) {
+        return false;
+    }
+    shared_buffer = (SharedBuffer *)segment.addr;
+    const char* layout_error = header_check(shared_buffer, segment.size);
+    if (layout_error) {
+        std::cerr << "Error: " << layout_error << ".\n";
+        return false;
+    }
+    if (shared_buffer->header.transport != TRANSPORT_BROADCAST) {
+        std::cerr << "Error: only a broadcast ring can be shared by several consumers, start the first consumer with broadcast.\n";
+        return false;
+    }
+    reader = broadcast_register(shared_buffer, lossy);
+    if (!reader) {
+        std::cerr << "Error: all " << MAX_READERS << " reader cursors are in use.\n";
+        return false;
+    }
+    return true;
+}
+
+// ===========================================================================================
+// Main function
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Error not enough arguments sent.\nUsage: ./consumer <BUFFER_SIZE> [sem|lockfree|sharded|broadcast] [--lossy] [--window N] [--fps N]\n"
+                     "                  [--latency-file FILE] [--latency-interval S] [--shm NAME] [--hugepages] [--prefault]\n"
+                     "                  [--headless] [--duration S] [--report FILE] [--cpu LIST] [--numa-node N]\n"
+                     "                  [--wait spin|pause|yield|block|adaptive] [--journal DIR] [--reset]\n"
+                     "       ./consumer --attach [--lossy] [--window N] [--fps N] [--latency-file FILE] [--latency-interval S] [--shm NAME]   (extra reader of a broadcast ring)\n"
+                     "       ./consumer --view [--fps N] [--duration S] [--shm NAME] [--hugepages]   (last prices only, never slows the producers)\n"
+                     "       ./consumer --reset [--shm NAME] [--hugepages]   (remove a shared buffer left behind)\n";
+        return 1;
+    }
+
+    signal(SIGINT, handle_sigint); // listen for termination process and calls handle_siginit dunction.
+    signal(SIGUSR1, handle_sigusr1); // kill -USR1 <pid> prints a latency report
+    int buffer_size = 0;
+    int transport = TRANSPORT_SEMAPHORE;
+    bool lossy = false;
+    int window = DEFAULT_WINDOW;
+    int fps = DEFAULT_FPS;
+    bool headless = false;      // No dashboard, for benchmarks
+    int duration = 0;           // Seconds before exiting as if interrupted, 0 to run until SIGINT
+    std::vector<int> cpus;      // Drain, compute and render threads take one each in turn
+    int numa_node = -1;         // Threads, per-symbol state and the segment on this node
+    int wait = WAIT_ADAPTIVE;
+    bool reset = false;         // Replace a segment left by a dead consumer instead of reattaching to it
+    ShmOptions shm_options;
+    for (int i = 1; i < argc; ) {
+        int used = shm_parse_option(shm_options, argc, argv, i);
+        if (used > 0) {
+            i += used;
+            continue;
+        }
+        if (strcmp(argv[i], "lockfree") == 0) {
+            transport = TRANSPORT_LOCKFREE;
+        } else if (strcmp(argv[i], "sharded") == 0) {
+            transport = TRANSPORT_SHARDED;
+        } else if (strcmp(argv[i], "broadcast") == 0) {
+            transport = TRANSPORT_BROADCAST;
+        } else if (strcmp(argv[i], "--view") == 0) {
+            view = true;
+        } else if (strcmp(argv[i], "--attach") == 0) {
+            attach = true;
+        } else if (strcmp(argv[i], "--reset") == 0) {
+            reset = true;
+        } else if (strcmp(argv[i], "--lossy") == 0) {
+            lossy = true;
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            window = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--latency-file") == 0 && i + 1 < argc) {
+            latency_file = fopen(argv[++i], "a");
+            if (!latency_file) {
+                perror("Failed to open the latency report file");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--latency-interval") == 0 && i + 1 < argc) {
+            latency_interval = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc) {
+            journal_dir = argv[++i];
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            bench_report_path = argv[++i];
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            if (!parse_cpu_list(argv[++i], cpus)) {
+                std::cerr << "Error Invalid CPU list " << argv[i] << ", must be like 3 or 0-3,8.\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--numa-node") == 0 && i + 1 < argc) {
+            numa_node = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--wait") == 0 && i + 1 < argc) {
+            wait = wait_parse_strategy(argv[++i]);
+            if (wait == -1) {
+                std::cerr << "Error Invalid wait strategy " << argv[i] << ", must be spin, pause, yield, block or adaptive.\n";
+                return 1;
+            }
+        } else if (i == 1) {
+            buffer_size = std::stoi(argv[i]);
+        } else if (strcmp(argv[i], "sem") != 0) {
+            std::cerr << "Error Invalid transport or option " << argv[i] << ".\nMust enter one of these: sem, lockfree, sharded, broadcast\n";
+            return 1;
+        }
+        i++;
+    }
+    if (lossy && !attach && transport != TRANSPORT_BROADCAST) {
+        std::cerr << "Error --lossy only applies to broadcast readers.\n";
+        return 1;
+    }
+    if (window < MIN_WINDOW || window > MAX_WINDOW) {
+        std::cerr << "Invalid window, must be between " << MIN_WINDOW << " and " << MAX_WINDOW << " prices.\n";
+        return 1;
+    }
+    if (latency_interval < 0) {
+        std::cerr << "Invalid latency report interval, must be 0 or more seconds.\n";
+        return 1;
+    }
+    if (duration < 0) {
+        std::cerr << "Invalid duration, must be 0 or more seconds.\n";
+        return 1;
+    }
+    if (numa_node != -1) {
+        // Without --cpu the threads float over the node's CPUs. Memory allocated from here on, such as the
+        // per-symbol latency histograms and rolling windows, comes from the node.
+        std::vector<int> node_cpus;
+        if (!numa_node_cpus(numa_node, node_cpus)) {
+            std::cerr << "Invalid NUMA node, must be one with CPUs between 0 and " << numa_node_count() - 1 << ".\n";
+            return 1;
+        }
+        if ((cpus.empty() && !pin_to_cpus(node_cpus)) || !numa_prefer(numa_node)) {
+            return 1;
+        }
+    }
+    if (!cpus.empty() && !pin_to_cpus(cpus)) {
+        return 1;
+    }
+    wait_set_strategy(wait);    // After pinning, adaptive looks at the CPUs left to it
+    if (fps < 1 || fps > MAX_FPS) {
+        std::cerr << "Invalid frame rate, must be between 1 and " << MAX_FPS << ".\n";
+        return 1;
+    }
+    if (view) {
+        // Any number of viewers can run, they only read the last-value cache
+        if (!shm_attach(shm_options, segment)) {
+            return 1;
+        }
+        shared_buffer = (SharedBuffer *)segment.addr;
+        const char* layout_error = header_check(shared_buffer, segment.size);
+        if (layout_error) {
+            std::cerr << "Error: " << layout_error << ".\n";
+            return 1;
+        }
+        if (duration > 0) {
+            signal(SIGALRM, handle_sigint);
+            alarm(duration);
+        }
+        render_loop(window, fps);
+        return shutdown();
+    }
+    if (reset && !attach && buffer_size == 0) {
+        // Only clean up
+        bool reattached;
+        if (shm_exists(shm_options) && !recover_ipc(shm_options, true, false, reattached)) {
+            return 1;
+        }
+        printf("No shared buffer left.\n");
+        return 0;
+    }
+    int max_buffer_size = transport == TRANSPORT_SEMAPHORE ? MAX_SEM_BUFFER_SIZE : MAX_BUFFER_SIZE;
+    if (!attach && (buffer_size < 1 || buffer_size > max_buffer_size)){
+        std::cerr << "Invalid Buffer size, must be between 1 and " << max_buffer_size << " for this transport.\n";
+        return 1;
+    }
+    // Indexes wrap with a mask, so the buffer size is rounded up to a power of two
+    if (!attach && round_up_pow2(buffer_size) != buffer_size) {
+        buffer_size = round_up_pow2(buffer_size);
+        std::cout << "Buffer size rounded up to " << buffer_size << ".\n";
+    }
+
+
+    if (journal_dir && !journal.open(journal_dir)) {
+        return 1;
+    }
+
+    if (attach) {
+        // Extra reader of a broadcast ring created by another consumer
+        if (!attach_ipc(shm_options, lossy)) {
+            return 1;
+        }
+        transport = shared_buffer->header.transport;
+        buffer_size = shared_buffer->header.buffer_size;
+    } else {
+        if (!create_ipc(shm_options, buffer_size, transport, lossy, reset)) {
+            return 1;
+        }
+        // A reattached segment keeps the transport and size it was created with
+        if (shared_buffer->header.transport != transport || shared_buffer->header.buffer_size != buffer_size) {
+            std::cout << "Using the reattached buffer's " << shared_buffer->header.buffer_size << " slots and its transport.\n";
+        }
+        transport = shared_buffer->header.transport;
+        buffer_size = shared_buffer->header.buffer_size;
+    }
+    journal.symbols(&shared_buffer->symbols);
+    if (numa_node != -1 && !attach) {
+        numa_bind(segment.addr, segment.size, numa_node);      // The report below shows whether it took
+    }
+    print_placement(numa_node, segment.addr, segment.size);
+    if (cpus.size() > 1) {
+        std::cout << "Threads: drain on CPU " << cpus[0] << ", compute on CPU " << cpus[1]
+                  << (headless ? "" : ", render on CPU " + std::to_string(cpus[2 % cpus.size()])) << ".\n";
+    }
+    if (transport == TRANSPORT_BROADCAST) {
+        std::cout << "Reading the broadcast ring as " << (lossy ? "a lossy" : "a gating") << " reader.\n";
+    }
+
+    // Drain (this thread) -> compute -> render. Only the drain stage touches the shared buffer,
+    // so the mutex is held just long enough to copy the ticks out.
+    std::cout << "Drain -> compute pipeline: " << PIPELINE_SIZE << " ticks, " << PIPELINE_SYNC::name() << " sync (PIPELINE_SYNC).\n";
+
+    // SIGINT and SIGALRM must be handled by this thread, the worker threads inherit a mask that blocks them.
+    // The handler only sets the stop flag, the threads see it and return, and this thread joins them.
+    sigset_t sigint_set;
+    sigemptyset(&sigint_set);
+    sigaddset(&sigint_set, SIGINT);
+    sigaddset(&sigint_set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigint_set, nullptr);
+    std::thread compute_thread([cpus, window] { pin_thread(cpus, 1); compute_loop(window); });
+    std::thread render_thread;
+    if (!headless) {
+        render_thread = std::thread([cpus, window, fps] { pin_thread(cpus, 2); render_loop(window, fps); });
+    }
+    pthread_sigmask(SIG_UNBLOCK, &sigint_set, nullptr);
+    pin_thread(cpus, 0);
 
-       
-        
-        int bufferprice, comm_index;
-        pop(shared_buffer, bufferprice, comm_index); // Pop the price and commodity index from the buffer
-        int index = shared_buffer->write_index[comm_index]; // Get the current write index for commodity i
-        double latest_price;
-        double average_val = 0.00;
-        if (latest_price != bufferprice){
-            perror("something is wrong with the buffer");
-        }
-        
-         // Check for circular buffer edge case
-         if (index == 0) {
-             latest_price = shared_buffer->prices[comm_index][4]; // Access the last position if index is 0
-         } else {
-             latest_price = shared_buffer->prices[comm_index][index - 1]; // Access the most recent price otherwise
-         }
-
-         if (shared_buffer->prices[comm_index][index] > 0) {
-            average_val = (shared_buffer->prices[comm_index][0] + shared_buffer->prices[comm_index][1] + shared_buffer->prices[comm_index][2] + shared_buffer->prices[comm_index][3] + shared_buffer->prices[comm_index][4] ) / 5;
+    // A timed run ends exactly like an interrupted one
+    if (duration > 0) {
+        signal(SIGALRM, handle_sigint);
+        alarm(duration);
+    }
+
+    int max_batch = std::min(buffer_size, MAX_BATCH);
+    std::vector<Tick> batch(max_batch);
+
+    while (!wait_stopping()) {
+        int batch_count = 0;
+        uint64_t waited = wait_thread_ns();
+        uint64_t skipped_before = skipped_ticks;
+        if (transport != TRANSPORT_SEMAPHORE) {
+            // Drain everything that is ready in one go
+            if (transport == TRANSPORT_SHARDED) {
+                batch_count = shards_pop_batch(shared_buffer, batch.data(), max_batch);
+            } else if (transport == TRANSPORT_BROADCAST) {
+                batch_count = broadcast_pop_batch(shared_buffer, reader, batch.data(), max_batch, skipped_ticks);
+            } else {
+                batch_count = ring_pop_batch(&shared_buffer->ring, batch.data(), max_batch);
+            }
+        } else {
+            if (!semWait(sem_filled_id)) { // Wait until at least one producer produces.
+                break;
             }
 
-        // Store the last price and average price of each commodity
-        prev_price[comm_index] = current_prices[comm_index];
-        current_prices[comm_index] = latest_price;
-        prev_avg[comm_index] = current_avg[comm_index];
-        current_avg[comm_index] = average_val;
-        
+            // Claim every other filled slot too. Only the consumer decreases filled, so this never blocks.
+            int ready = semctl(sem_filled_id, 0, GETVAL);
+            if (ready == -1) {
+                perror("semctl GETVAL for filled failed");
+                exit(EXIT_FAILURE);
+            }
+            batch_count = 1 + std::min(ready, max_batch - 1);
+            if (batch_count > 1 && !semWait(sem_filled_id, batch_count - 1)) {
+                break;
+            }
+            uint32_t wait_start = monotonic_us();
+            if (!semLock(sem_mutex_id)) { // Lock mutex
+                break;      // Claimed filled units are put right by the next consumer's reattach
+            }
+            uint32_t locked = monotonic_us();
+
+    // -------------------------------------Critical Section-------------------------------------
+
+            // Pop the ticks from the buffer. Fewer than claimed if filled ran ahead of the queue (a tick
+            // push() refused), only those are processed and given back as room.
+            batch_count = pop_batch(shared_buffer, batch.data(), batch_count);
 
     // -------------------------------------End of Critical Section-------------------------------------
 
-        semSignal(sem_mutex_id); // Unlock mutex
-        semSignal(sem_available_id); // Signal filled
+            semUnlock(sem_mutex_id); // Unlock mutex
+            if (batch_count > 0) {
+                semSignal(sem_available_id, batch_count); // Signal available for every slot freed
+            }
+            consumer_lock_wait.record(locked - wait_start);
+        }
+        if (batch_count == 0 && wait_stopping()) {
+            break;
+        }
+
+        if (!attach) {
+            // Only the owner counts, attached readers see the same ticks
+            Metrics& m = shared_buffer->metrics;
+            metric_add_owned(m.consumer.ticks, batch_count);
+            metric_add_owned(m.consumer.batches, 1);
+            metric_add_owned(m.consumer.idle_ns, wait_thread_ns() - waited);
+            metric_add_owned(m.consumer.skipped, skipped_ticks - skipped_before);
+            for (int i = 0; i < batch_count; i++) {
+                metric_add_owned(m.symbol_ticks[batch[i].comm_index], 1);
+            }
+        }
 
+        // Split each tick's time so far into the producer's wait and the time spent queued
+        uint32_t dequeued = monotonic_us();
+        for (int i = 0; i < batch_count; i++) {
+            uint32_t lag = lag_decode(batch[i].enqueue_lag);
+            uint32_t age = dequeued - batch[i].ts_us;
+            SymbolLatency& latency = latency_of(batch[i].comm_index);
+            latency.enqueue_wait.record(lag);
+            latency.queue_latency.record(age > lag ? age - lag : 0);
+            all_queue_latency.record(age > lag ? age - lag : 0);
+        }
+        if (ticks_consumed == 0) {
+            first_tick_time = std::chrono::steady_clock::now();
+        }
+        ticks_consumed += batch_count;
+        if (journal_dir) {
+            journal.append(batch.data(), batch_count);
+        }
+
+        // Hand the copies to the compute thread, waiting only if it is a whole pipeline behind
+        pipeline.push_batch(batch.data(), batch_count);
     }
 
-    return 0;
+    compute_thread.join();
+    if (render_thread.joinable()) {
+        render_thread.join();
+    }
+    return shutdown();
 }
@@ -0,0 +1,251 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+// Pinning processes to CPUs, so benchmark runs don't depend on where the scheduler puts them,
+// and placing memory on NUMA nodes. The topology comes from /sys/devices/system/node and the memory
+// policy calls are made through syscall(), so there is no libnuma dependency; on a machine without
+// NUMA everything is node 0.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define MAX_NUMA_NODES 64               // Nodes a policy mask can name (one unsigned long)
+#define NUMA_MPOL_PREFERRED 1           // <numaif.h> values
+#define NUMA_MPOL_BIND 2
+#define NUMA_MPOL_MF_MOVE (1 << 1)
+
+// Number of CPUs this process may run on
+inline int cpu_count() {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        return 1;
+    }
+    return CPU_COUNT(&set);
+}
+
+// Parse a CPU (or node) list such as "3" or "0-3,8". Returns false if it doesn't parse.
+inline bool parse_cpu_list(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    std::stringstream in(text);
+    std::string part;
+    while (std::getline(in, part, ',')) {
+        char* end;
+        long first = strtol(part.c_str(), &end, 10);
+        long last = first;
+        if (end == part.c_str() || first < 0) {
+            return false;
+        }
+        if (*end == '-') {
+            const char* second = end + 1;
+            last = strtol(second, &end, 10);
+            if (end == second || last < first) {
+                return false;
+            }
+        }
+        if (*end != '\0' && *end != '\n') {
+            return false;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            cpus.push_back((int)cpu);
+        }
+    }
+    return !cpus.empty();
+}
+
+// The other way round, for reports: {0, 1, 2, 3, 8} is "0-3,8"
+inline std::string cpu_list_text(const std::vector<int>& cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); ) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            j++;
+        }
+        text += (text.empty() ? "" : ",") + std::to_string(cpus[i]);
+        if (j > i) {
+            text += "-" + std::to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return text;
+}
+
+// CPUs the calling thread may run on
+inline std::vector<int> current_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+// Pin the calling thread (and threads it creates later) to cpus. Returns false after printing the error.
+inline bool pin_to_cpus(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); i++) {
+        CPU_SET(cpus[i], &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror(("Failed to pin to CPUs " + cpu_list_text(cpus)).c_str());
+        return false;
+    }
+    return true;
+}
+
+inline bool pin_to_cpu(int cpu) {
+    return pin_to_cpus(std::vector<int>(1, cpu));
+}
+
+// Pin the calling thread to the k-th CPU of cpus, wrapping around, so each thread of a process gets
+// its own CPU when the list is long enough. Nothing happens for an empty list.
+inline void pin_thread(const std::vector<int>& cpus, int k) {
+    if (!cpus.empty()) {
+        pin_to_cpu(cpus[k % cpus.size()]);
+    }
+}
+
+// ---------------------------------------- NUMA ----------------------------------------
+
+inline std::string numa_sysfs(const std::string& file) {
+    std::ifstream in("/sys/devices/system/node/" + file);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+// Number of NUMA nodes (1 when the kernel doesn't report any)
+inline int numa_node_count() {
+    std::vector<int> nodes;
+    if (!parse_cpu_list(numa_sysfs("possible"), nodes)) {
+        return 1;
+    }
+    return std::min(nodes.back() + 1, MAX_NUMA_NODES);
+}
+
+// CPUs of a node. Returns false if the node doesn't exist or has no CPUs.
+inline bool numa_node_cpus(int node, std::vector<int>& cpus) {
+    if (node < 0 || node >= numa_node_count()) {
+        return false;
+    }
+    if (numa_node_count() == 1 && numa_sysfs("node0/cpulist").empty()) {
+        cpus = current_cpus();      // No sysfs node directory, all CPUs are node 0
+        return !cpus.empty();
+    }
+    return parse_cpu_list(numa_sysfs("node" + std::to_string(node) + "/cpulist"), cpus);
+}
+
+// Node of a CPU, 0 if it can't be told
+inline int numa_cpu_node(int cpu) {
+    for (int node = 0; node < numa_node_count(); node++) {
+        std::vector<int> cpus;
+        if (numa_node_cpus(node, cpus)) {
+            for (size_t i = 0; i < cpus.size(); i++) {
+                if (cpus[i] == cpu) {
+                    return node;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Allocate this process' memory from node from now on, falling back to other nodes when it is full.
+// Returns false after printing the error.
+inline bool numa_prefer(int node) {
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_set_mempolicy, NUMA_MPOL_PREFERRED, &mask, (unsigned long)MAX_NUMA_NODES) == -1) {
+        perror("Failed to set the NUMA memory policy");
+        return false;
+    }
+    return true;
+}
+
+// Keep the pages of [addr, addr + size) on node, moving those already faulted in. On shared memory the
+// policy belongs to the segment, so pages other processes fault in later land there too.
+// Returns false after printing the error.
+inline bool numa_bind(void* addr, size_t size, int node) {
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_mbind, addr, size, NUMA_MPOL_BIND, &mask, (unsigned long)MAX_NUMA_NODES, NUMA_MPOL_MF_MOVE) == -1) {
+        perror("Failed to bind shared memory to the NUMA node");
+        return false;
+    }
+    return true;
+}
+
+// Where the pages of [addr, addr + size) are: pages per node, and pages nothing has touched yet.
+// Returns false if the kernel can't tell (no move_pages).
+inline bool numa_page_nodes(const void* addr, size_t size, std::vector<long>& per_node, long& untouched) {
+    const size_t page = 4096;
+    size_t count = (size + page - 1) / page;
+    std::vector<void*> pages(count);
+    std::vector<int> status(count);
+    for (size_t i = 0; i < count; i++) {
+        pages[i] = (char*)addr + i * page;
+    }
+    // No target nodes: only reports the node of each page
+    if (syscall(SYS_move_pages, 0, count, pages.data(), nullptr, status.data(), 0) == -1) {
+        return false;
+    }
+    per_node.assign(numa_node_count(), 0);
+    untouched = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (status[i] >= 0 && status[i] < (int)per_node.size()) {
+            per_node[status[i]]++;
+        } else {
+            untouched++;
+        }
+    }
+    return true;
+}
+
+// Startup report: the CPUs (and nodes) this thread may use, the memory policy, and where the shared
+// segment's pages are, with a warning when most of them are on a node none of the CPUs belongs to
+inline void print_placement(int preferred_node, const void* segment, size_t segment_size) {
+    std::vector<int> cpus = current_cpus();
+    std::vector<bool> local(numa_node_count(), false);
+    std::vector<int> nodes;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        int node = numa_cpu_node(cpus[i]);
+        if (!local[node]) {
+            local[node] = true;
+            nodes.push_back(node);
+        }
+    }
+    std::cout << "Placement: CPUs " << cpu_list_text(cpus) << " (node " << cpu_list_text(nodes) << " of "
+              << numa_node_count() << "), memory "
+              << (preferred_node >= 0 ? "from node " + std::to_string(preferred_node) : "first touch") << ".\n";
+
+    std::vector<long> per_node;
+    long untouched;
+    if (!numa_page_nodes(segment, segment_size, per_node, untouched)) {
+        return;
+    }
+    long near = 0, far = 0;
+    std::cout << "Shared segment pages:";
+    for (size_t node = 0; node < per_node.size(); node++) {
+        if (per_node[node] > 0) {
+            std::cout << " " << per_node[node] << " on node " << node;
+            (local[node] ? near : far) += per_node[node];
+        }
+    }
+    std::cout << " (" << untouched << " not touched yet).\n";
+    if (far > near) {
+        std::cout << "Warning: most of the shared segment is on a remote node, see --numa-node.\n";
+    }
+}
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+// Append-only tick journal (consumer --journal DIR, read back by ./replay).
+// Ticks are stored exactly as dequeued (16-byte Tick records) in preallocated, memory-mapped segment
+// files DIR/journal-NNNNNN.bin, so appending a batch is one memcpy. The header of each segment holds the
+// committed record count, written after the records, so a segment is readable at any time (also after
+// a crash) up to that count, and the names of the symbol ids its records use (ids are only meaningful
+// within the segment). Tick timestamps are 32-bit and wrap, the journal keeps them unwrapped into
+// 64-bit microseconds for its time span and its time index: every JOURNAL_INDEX_STRIDE-th record gets an
+// entry (time, record number), so a replay can seek without scanning.
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shared_buffer.h"
+
+#define JOURNAL_MAGIC "L5JRNL"
+#define JOURNAL_VERSION 2
+#define JOURNAL_SEGMENT_TICKS (1 << 20)     // Records per segment file (16MB of ticks)
+#define JOURNAL_INDEX_STRIDE 1024           // Records between two index entries
+#define JOURNAL_INDEX_ENTRIES (JOURNAL_SEGMENT_TICKS / JOURNAL_INDEX_STRIDE)
+
+struct JournalIndexEntry {
+    uint64_t time_us;       // Unwrapped producer timestamp of the tick
+    uint64_t record;        // Its record number in the segment
+};
+
+struct JournalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;                              // Records the segment has room for
+    std::atomic<uint64_t> count;                    // Records committed (stored after them)
+    uint64_t first_time_us;                         // Unwrapped timestamps of the first and last record
+    uint64_t last_time_us;
+    int64_t wall_offset_us;                         // CLOCK_REALTIME minus CLOCK_MONOTONIC when created
+    uint32_t index_count;
+    uint32_t ticks[MAX_SYMBOLS];                    // Records per symbol id
+    char names[MAX_SYMBOLS][SYMBOL_NAME_SIZE];      // Name of each id with records, from the live registry
+    JournalIndexEntry index[JOURNAL_INDEX_ENTRIES];
+};
+
+inline size_t journal_records_offset() {
+    return (sizeof(JournalHeader) + 4095) / 4096 * 4096;
+}
+
+inline size_t journal_segment_bytes(uint64_t capacity) {
+    return journal_records_offset() + capacity * sizeof(Tick);
+}
+
+inline Tick* journal_records(JournalHeader* h) {
+    return reinterpret_cast<Tick*>(reinterpret_cast<char*>(h) + journal_records_offset());
+}
+
+inline const Tick* journal_records(const JournalHeader* h) {
+    return reinterpret_cast<const Tick*>(reinterpret_cast<const char*>(h) + journal_records_offset());
+}
+
+inline std::string journal_segment_path(const std::string& dir, int number) {
+    char name[32];
+    snprintf(name, sizeof(name), "/journal-%06d.bin", number);
+    return dir + name;
+}
+
+// Segment numbers present in dir, in order
+inline std::vector<int> journal_list_segments(const std::string& dir) {
+    std::vector<int> numbers;
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return numbers;
+    }
+    while (dirent* entry = readdir(d)) {
+        int number;
+        char tail;
+        if (sscanf(entry->d_name, "journal-%d.bi%c", &number, &tail) == 2 && tail == 'n') {
+            numbers.push_back(number);
+        }
+    }
+    closedir(d);
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+// Extend a wrapping 32-bit microsecond timestamp next to the last unwrapped one. Ticks from several
+// producers arrive slightly out of order, so the difference is taken as signed.
+inline uint64_t journal_unwrap(uint64_t last_us, uint32_t ts_us) {
+    return last_us + (int64_t)(int32_t)(ts_us - (uint32_t)last_us);
+}
+
+class JournalWriter {
+public:
+    JournalWriter() : header_(nullptr), symbols_(nullptr), fd_(-1), number_(0), appended_(0), last_us_(0), started_(false), first_(true) {}
+
+    // Create dir if needed and start a segment after the ones already there. Returns false after printing the error.
+    bool open(const std::string& dir) {
+        if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+            perror("Failed to create the journal directory");
+            return false;
+        }
+        dir_ = dir;
+        std::vector<int> existing = journal_list_segments(dir);
+        number_ = existing.empty() ? 0 : existing.back() + 1;
+        return open_segment();
+    }
+
+    // Registry the ids of the appended ticks refer to, their names are copied into each segment
+    void symbols(const SymbolTable* table) { symbols_ = table; }
+
+    // Append n ticks, moving to a new segment when this one is full
+    void append(const Tick ticks[], int n) {
+        while (n > 0 && header_) {
+            uint64_t count = header_->count.load(std::memory_order_relaxed);
+            if (count == header_->capacity) {
+                close_segment();
+                number_++;
+                if (!open_segment()) {
+                    return;
+                }
+                continue;
+            }
+            int now = (int)std::min<uint64_t>(n, header_->capacity - count);
+            memcpy(journal_records(header_) + count, ticks, now * sizeof(Tick));
+            for (int i = 0; i < now; i++) {
+                index(ticks[i], count + i);
+            }
+            header_->last_time_us = last_us_;
+            header_->count.store(count + now, std::memory_order_release);
+            appended_ += now;
+            ticks += now;
+            n -= now;
+        }
+    }
+
+    // Ask the kernel to write out what has been appended so far. Meant for exit: the segment stays
+    // mapped (the drain thread may still be appending), the kernel unmaps it with the process.
+    void sync() {
+        if (header_) {
+            size_t used = journal_segment_bytes(header_->count.load());
+            msync(header_, used, MS_SYNC);
+        }
+    }
+
+    int segment() const { return number_; }
+    uint64_t appended() const { return appended_; }     // Ticks appended by this writer
+
+private:
+    bool open_segment() {
+        std::string path = journal_segment_path(dir_, number_);
+        size_t bytes = journal_segment_bytes(JOURNAL_SEGMENT_TICKS);
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd_ == -1) {
+            perror(("Failed to create journal segment " + path).c_str());
+            return false;
+        }
+        // Reserve the blocks up front: running out of disk later would be a SIGBUS in the middle of an append
+        int error = posix_fallocate(fd_, 0, bytes);
+        if (error != 0) {
+            fprintf(stderr, "Failed to preallocate journal segment %s: %s\n", path.c_str(), strerror(error));
+            ::close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        void* addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (addr == MAP_FAILED) {
+            perror("Failed to map the journal segment");
+            ::close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        header_ = static_cast<JournalHeader*>(addr);
+        memset(static_cast<void*>(header_), 0, sizeof(JournalHeader));
+        memcpy(header_->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        header_->version = JOURNAL_VERSION;
+        header_->record_size = sizeof(Tick);
+        header_->capacity = JOURNAL_SEGMENT_TICKS;
+        header_->count.store(0);
+
+        timespec real, mono;
+        clock_gettime(CLOCK_REALTIME, &real);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        header_->wall_offset_us = ((int64_t)real.tv_sec - mono.tv_sec) * 1000000 + (real.tv_nsec - mono.tv_nsec) / 1000;
+        header_->first_time_us = header_->last_time_us = last_us_;
+        first_ = true;
+        return true;
+    }
+
+    void close_segment() {
+        if (!header_) {
+            return;
+        }
+        size_t bytes = journal_segment_bytes(header_->capacity);
+        msync(header_, journal_segment_bytes(header_->count.load()), MS_ASYNC);
+        munmap(header_, bytes);
+        ::close(fd_);
+        header_ = nullptr;
+        fd_ = -1;
+    }
+
+    void index(const Tick& tick, uint64_t record) {
+        if (!started_) {
+            // The very first tick: unwrap it next to the full monotonic clock, so the wall offset applies
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            last_us_ = journal_unwrap((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000, tick.ts_us);
+            started_ = true;
+        } else {
+            last_us_ = journal_unwrap(last_us_, tick.ts_us);
+        }
+        if (first_) {
+            header_->first_time_us = last_us_;
+            first_ = false;
+        }
+        int c = tick.comm_index;
+        if (c < MAX_SYMBOLS && header_->ticks[c]++ == 0 && symbols_) {
+            memcpy(header_->names[c], symbol_name(symbols_, c), SYMBOL_NAME_SIZE);
+        }
+        if (record % JOURNAL_INDEX_STRIDE == 0 && header_->index_count < JOURNAL_INDEX_ENTRIES) {
+            JournalIndexEntry& e = header_->index[header_->index_count++];
+            e.time_us = last_us_;
+            e.record = record;
+        }
+    }
+
+    std::string dir_;
+    JournalHeader* header_;
+    const SymbolTable* symbols_;
+    int fd_;
+    int number_;
+    uint64_t appended_;
+    uint64_t last_us_;      // Unwrapped timestamp of the last tick appended
+    bool started_;          // last_us_ is set
+    bool first_;            // No record in the current segment yet
+};
+
+// A segment mapped read-only. Returns nullptr after printing the error.
+inline const JournalHeader* journal_map_segment(const std::string& path, size_t& bytes) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        perror(("Failed to open journal segment " + path).c_str());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < journal_records_offset()) {
+        fprintf(stderr, "Journal segment %s is truncated.\n", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+    bytes = st.st_size;
+    void* addr = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("Failed to map the journal segment");
+        return nullptr;
+    }
+    const JournalHeader* h = static_cast<const JournalHeader*>(addr);
+    if (memcmp(h->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || h->version != JOURNAL_VERSION ||
+        h->record_size != sizeof(Tick) || journal_segment_bytes(h->capacity) > bytes) {
+        fprintf(stderr, "%s is not a journal segment of this build.\n", path.c_str());
+        munmap(addr, bytes);
+        return nullptr;
+    }
+    return h;
+}
+
+// First record of a segment worth reading for ticks at or after time_us, from the time index, and the
+// unwrapped timestamp of that record in start_us. Ticks of several producers arrive slightly out of
+// order, so the search stops one entry early: everything before the returned record is older.
+inline uint64_t journal_seek(const JournalHeader* h, uint64_t time_us, uint64_t& start_us) {
+    start_us = h->first_time_us;
+    uint32_t low = 0, high = h->index_count;    // Find the first entry later than time_us
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (h->index[mid].time_us <= time_us) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < 2) {
+        return 0;
+    }
+    start_us = h->index[low - 2].time_us;
+    return h->index[low - 2].record;
+}
+
+// Id a segment uses for a symbol name, or -1 if it has no ticks of it
+inline int journal_find_symbol(const JournalHeader* h, const std::string& name) {
+    char normalized[SYMBOL_NAME_SIZE];
+    if (!symbol_normalize(name, normalized)) {
+        return -1;
+    }
+    for (int c = 0; c < MAX_SYMBOLS; c++) {
+        if (h->ticks[c] > 0 && strcmp(h->names[c], normalized) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+#endif
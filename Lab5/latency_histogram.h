@@ -0,0 +1,89 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+// HDR-style latency histogram in microseconds.
+// Values below 64 get their own bucket, larger ones fall in one of 32 buckets per power of two,
+// so every value is recorded with at most ~3% error up to 2^32 us, in a fixed 7KB table.
+// One thread records (relaxed atomic stores), any thread may read it for a report.
+
+#include <atomic>
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)                     // Buckets per power of two
+#define HIST_LINEAR_LIMIT (2 * HIST_SUB_COUNT)                  // Values below this are exact
+#define HIST_BUCKETS (HIST_LINEAR_LIMIT + (32 - HIST_SUB_BITS - 1) * HIST_SUB_COUNT)
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() : total_(0), max_(0) {
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            counts_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Single writer: plain load + store, no read-modify-write
+    void record(uint64_t us) {
+        std::atomic<uint64_t>& c = counts_[bucket(us)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total_.store(total_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (us > max_.load(std::memory_order_relaxed)) {
+            max_.store(us, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    // Smallest recorded value v such that at least fraction q of the values are <= v (upper bucket edge)
+    uint64_t percentile(double q) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(q * total + 0.5);
+        if (rank < 1) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t upper = bucket_upper(i);
+                return upper < max() ? upper : max();
+            }
+        }
+        return max();
+    }
+
+private:
+    static int bucket(uint64_t us) {
+        if (us < HIST_LINEAR_LIMIT) {
+            return (int)us;
+        }
+        if (us > 0xFFFFFFFFull) {
+            us = 0xFFFFFFFFull;
+        }
+        int top = 63 - __builtin_clzll(us);                         // >= HIST_SUB_BITS + 1
+        int shift = top - HIST_SUB_BITS;
+        int sub = (int)(us >> shift) & (HIST_SUB_COUNT - 1);
+        return HIST_LINEAR_LIMIT + (top - HIST_SUB_BITS - 1) * HIST_SUB_COUNT + sub;
+    }
+
+    // Largest value that falls in bucket i
+    static uint64_t bucket_upper(int i) {
+        if (i < HIST_LINEAR_LIMIT) {
+            return i;
+        }
+        int top = (i - HIST_LINEAR_LIMIT) / HIST_SUB_COUNT + HIST_SUB_BITS + 1;
+        int sub = (i - HIST_LINEAR_LIMIT) % HIST_SUB_COUNT;
+        int shift = top - HIST_SUB_BITS;
+        return (((uint64_t)(HIST_SUB_COUNT + sub + 1)) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> counts_[HIST_BUCKETS];
+    std::atomic<uint64_t> total_;
+    std::atomic<uint64_t> max_;
+};
+
+#endif
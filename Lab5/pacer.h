@@ -0,0 +1,146 @@
+#ifndef PACER_H
+#define PACER_H
+
+// Rate control for the producers.
+// Ticks are released against absolute deadlines (clock_nanosleep TIMER_ABSTIME), so time spent generating
+// and publishing doesn't add up into drift. The last PACE_SPIN_NS before a deadline are spent busy-waiting
+// on the TSC, which gets sub-microsecond release times for the 100k+ ticks/sec rates a timer can't reach.
+// A token bucket lets a producer that fell behind catch up with up to burst ticks back to back, anything
+// older is skipped (and counted) rather than sent as one long burst.
+
+#include <cmath>
+#include <stdint.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "price_gen.h"
+#include "wait_strategy.h"
+
+#define PACE_SPIN_NS 10000          // Below this a deadline is busy-waited instead of slept for
+#define PACE_CALIBRATE_NS 20000000  // How long the TSC is measured against CLOCK_MONOTONIC
+
+inline uint64_t pace_clock() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// TSC ticks per nanosecond, measured once per process
+inline double pace_tsc_per_ns() {
+    static const double ratio = [] {
+        uint64_t start_ns = pace_clock();
+        uint64_t start_tsc = __rdtsc();
+        uint64_t now_ns;
+        do {
+            now_ns = pace_clock();
+        } while (now_ns - start_ns < PACE_CALIBRATE_NS);
+        return (double)(__rdtsc() - start_tsc) / (now_ns - start_ns);
+    }();
+    return ratio;
+}
+
+// Sleep until deadline_ns on CLOCK_MONOTONIC, spinning through the last PACE_SPIN_NS.
+// Long sleeps are cut into WAIT_STOP_POLL_NS slices and end early once the process is stopping.
+inline void pace_sleep_until(uint64_t deadline_ns) {
+    uint64_t now = pace_clock();
+    while (now < deadline_ns && deadline_ns - now > PACE_SPIN_NS) {
+        if (wait_stopping()) {
+            return;
+        }
+        uint64_t wake = deadline_ns - PACE_SPIN_NS;
+        if (wake - now > WAIT_STOP_POLL_NS) {
+            wake = now + WAIT_STOP_POLL_NS;
+        }
+        timespec ts;
+        ts.tv_sec = wake / 1000000000ull;
+        ts.tv_nsec = wake % 1000000000ull;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        now = pace_clock();
+    }
+    if (now >= deadline_ns) {
+        return;
+    }
+    uint64_t until = __rdtsc() + (uint64_t)((deadline_ns - now) * pace_tsc_per_ns());
+    while (__rdtsc() < until) {
+        _mm_pause();
+    }
+}
+
+// Exponential inter-arrival time with the given mean, for Poisson arrivals. state is a splitmix64 counter.
+inline double pace_exponential_ns(uint64_t& state, double mean_ns) {
+    uint64_t z = gen_splitmix64(state);
+    double u = 1.0 - (double)(z >> 11) * (1.0 / 9007199254740992.0);     // (0, 1]
+    return -std::log(u) * mean_ns;
+}
+
+class Pacer {
+public:
+    // rate: ticks per second, 0 for unpaced. burst: ticks that may go back to back after a stall.
+    // poisson: exponential gaps with mean 1/rate instead of a fixed period.
+    Pacer(double rate, int burst, bool poisson, uint64_t seed)
+        : rate_(rate), burst_(burst < 1 ? 1 : burst), poisson_(poisson), random_(seed),
+          period_ns_(rate > 0 ? 1e9 / rate : 0), start_ns_(pace_clock()), next_ns_(start_ns_),
+          sent_(0), skipped_(0), max_late_ns_(0) {
+        if (rate_ > 0) {
+            pace_tsc_per_ns();      // Calibrate now rather than on the first short wait
+            start_ns_ = next_ns_ = pace_clock();
+        }
+    }
+
+    // Block until n more ticks may be sent
+    void wait(int n) {
+        sent_ += n;
+        if (rate_ <= 0) {
+            return;
+        }
+        double now = (double)pace_clock();
+        if (now - next_ns_ > max_late_ns_) {
+            max_late_ns_ = (uint64_t)(now - next_ns_);
+        }
+        // Tokens stop accumulating at burst: a stalled producer can't bank unbounded credit
+        double credit_ns = burst_ * period_ns_;
+        if (next_ns_ < now - credit_ns) {
+            skipped_ += (uint64_t)((now - credit_ns - next_ns_) / period_ns_);
+            next_ns_ = now - credit_ns;
+        }
+        // The batch goes when the last of its n tokens is there
+        double deadline = next_ns_;
+        for (int i = 0; i < n - 1; i++) {
+            deadline += interval();
+        }
+        if (now < deadline) {
+            pace_sleep_until((uint64_t)deadline);
+        }
+        next_ns_ = deadline + interval();
+    }
+
+    double requested_rate() const { return rate_; }
+    uint64_t sent() const { return sent_; }
+    uint64_t skipped() const { return skipped_; }       // Ticks dropped after stalls longer than the burst
+    uint64_t max_late_ns() const { return max_late_ns_; }   // Furthest behind schedule a batch was
+
+    uint64_t elapsed_ns() const { return pace_clock() - start_ns_; }
+
+    double achieved_rate() const {
+        uint64_t elapsed = elapsed_ns();
+        return elapsed > 0 ? sent_ * 1e9 / elapsed : 0;
+    }
+
+private:
+    double interval() {
+        return poisson_ ? pace_exponential_ns(random_, period_ns_) : period_ns_;
+    }
+
+    double rate_;
+    int burst_;
+    bool poisson_;
+    uint64_t random_;
+    double period_ns_;
+    uint64_t start_ns_;
+    double next_ns_;            // Earliest release of the next tick (fractional, so periods don't round)
+    uint64_t sent_;
+    uint64_t skipped_;
+    uint64_t max_late_ns_;
+};
+
+#endif
@@ -0,0 +1,453 @@
+#ifndef PRICE_GEN_H
+#define PRICE_GEN_H
+
+// Vectorized Gaussian generator for the producers.
+// Eight independent xoshiro256** lanes feed a Box-Muller transform, 16 normals per step.
+// The step is written three times (AVX-512, AVX2, scalar) and picked at runtime from what the CPU supports.
+// All three do the same IEEE operations in the same order (no FMA, own log/sin/cos polynomials),
+// so a seed gives bit-identical prices whichever one runs.
+
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+#include <immintrin.h>
+
+// A fused multiply-add rounds once instead of twice, letting the compiler contract any of the
+// expressions below would break the bit-for-bit agreement between the implementations.
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+
+#define GEN_LANES 8
+#define GEN_BLOCK (2 * GEN_LANES)      // Normals produced per step
+
+enum GenIsa {
+    GEN_SCALAR = 0,
+    GEN_AVX2 = 1,
+    GEN_AVX512 = 2
+};
+
+// Constants shared by every implementation
+#define GEN_SQRT2 1.4142135623730951
+#define GEN_LN2 0.6931471805599453
+#define GEN_HALF_PI 1.5707963267948966
+#define GEN_TWO_POW_M52 (1.0 / 4503599627370496.0)
+
+// splitmix64, to expand one seed into the lanes' states
+inline uint64_t gen_splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// ---------------------------------------- Scalar ----------------------------------------
+
+inline uint64_t gen_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// One xoshiro256** step of lane i
+inline uint64_t gen_next_scalar(uint64_t s[4][GEN_LANES], int i) {
+    uint64_t s1 = s[1][i];
+    uint64_t x = (s1 << 2) + s1;                    // * 5
+    x = gen_rotl(x, 7);
+    uint64_t result = (x << 3) + x;                 // * 9
+    uint64_t t = s1 << 17;
+    s[2][i] ^= s[0][i];
+    s[3][i] ^= s[1][i];
+    s[1][i] ^= s[2][i];
+    s[0][i] ^= s[3][i];
+    s[2][i] ^= t;
+    s[3][i] = gen_rotl(s[3][i], 45);
+    return result;
+}
+
+inline double gen_bits_to_double(uint64_t bits) {
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+inline uint64_t gen_double_to_bits(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+// Natural log of u in (0, 1]: exponent plus log(m) for m in [sqrt(1/2), sqrt(2)) from the atanh series
+inline double gen_log_scalar(double u) {
+    uint64_t bits = gen_double_to_bits(u);
+    double e = gen_bits_to_double((bits >> 52) | 0x4330000000000000ull) - 4503599627370496.0 - 1023.0;
+    double m = gen_bits_to_double((bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull);
+    if (m > GEN_SQRT2) {
+        m = m * 0.5;
+        e = e + 1.0;
+    }
+    double f = m - 1.0;
+    double s = f / (2.0 + f);
+    double s2 = s * s;
+    double p = 1.0 / 17;
+    p = p * s2 + 1.0 / 15;
+    p = p * s2 + 1.0 / 13;
+    p = p * s2 + 1.0 / 11;
+    p = p * s2 + 1.0 / 9;
+    p = p * s2 + 1.0 / 7;
+    p = p * s2 + 1.0 / 5;
+    p = p * s2 + 1.0 / 3;
+    p = p * s2;
+    double two_s = s + s;
+    return e * GEN_LN2 + (two_s + two_s * p);
+}
+
+// sin and cos of x in [0, pi/2] (Taylor to x^17 / x^16)
+inline void gen_sincos_scalar(double x, double& sin_x, double& cos_x) {
+    double x2 = x * x;
+    double sp = -1.0 / 355687428096000.0;           // -1/17!
+    sp = sp * x2 + 1.0 / 1307674368000.0;
+    sp = sp * x2 - 1.0 / 6227020800.0;
+    sp = sp * x2 + 1.0 / 39916800.0;
+    sp = sp * x2 - 1.0 / 362880.0;
+    sp = sp * x2 + 1.0 / 5040.0;
+    sp = sp * x2 - 1.0 / 120.0;
+    sp = sp * x2 + 1.0 / 6.0;
+    sin_x = x - x * x2 * sp;
+    double cp = 1.0 / 20922789888000.0;             // 1/16!
+    cp = cp * x2 - 1.0 / 87178291200.0;
+    cp = cp * x2 + 1.0 / 479001600.0;
+    cp = cp * x2 - 1.0 / 3628800.0;
+    cp = cp * x2 + 1.0 / 40320.0;
+    cp = cp * x2 - 1.0 / 720.0;
+    cp = cp * x2 + 1.0 / 24.0;
+    cp = cp * x2 - 0.5;
+    cos_x = 1.0 + x2 * cp;
+}
+
+// Box-Muller on one pair of words. The angle is drawn in [0, pi/2) and two spare bits of w2 pick the
+// signs, which spreads it over the whole circle.
+inline void gen_box_muller_scalar(uint64_t w1, uint64_t w2, double& z0, double& z1) {
+    double u1 = 1.0 - (double)(w1 >> 12) * GEN_TWO_POW_M52;    // (0, 1]
+    double u2 = (double)(w2 >> 12) * GEN_TWO_POW_M52;          // [0, 1)
+    double r = std::sqrt(-2.0 * gen_log_scalar(u1));
+    double s, c;
+    gen_sincos_scalar(u2 * GEN_HALF_PI, s, c);
+    z0 = gen_bits_to_double(gen_double_to_bits(r * c) ^ ((w2 & 1) << 63));
+    z1 = gen_bits_to_double(gen_double_to_bits(r * s) ^ ((w2 & 2) << 62));
+}
+
+inline void gen_step_scalar(uint64_t s[4][GEN_LANES], double out[GEN_BLOCK]) {
+    uint64_t w1[GEN_LANES], w2[GEN_LANES];
+    for (int i = 0; i < GEN_LANES; i++) {
+        w1[i] = gen_next_scalar(s, i);
+    }
+    for (int i = 0; i < GEN_LANES; i++) {
+        w2[i] = gen_next_scalar(s, i);
+    }
+    for (int i = 0; i < GEN_LANES; i++) {
+        gen_box_muller_scalar(w1[i], w2[i], out[i], out[GEN_LANES + i]);
+    }
+}
+
+// ---------------------------------------- AVX2 (4 lanes per register, two halves) ----------------------------------------
+
+__attribute__((target("avx2")))
+inline __m256i gen_rotl_avx2(__m256i x, int k) {
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+__attribute__((target("avx2")))
+inline __m256i gen_next_avx2(__m256i& s0, __m256i& s1, __m256i& s2, __m256i& s3) {
+    __m256i x = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+    x = gen_rotl_avx2(x, 7);
+    __m256i result = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+    __m256i t = _mm256_slli_epi64(s1, 17);
+    s2 = _mm256_xor_si256(s2, s0);
+    s3 = _mm256_xor_si256(s3, s1);
+    s1 = _mm256_xor_si256(s1, s2);
+    s0 = _mm256_xor_si256(s0, s3);
+    s2 = _mm256_xor_si256(s2, t);
+    s3 = gen_rotl_avx2(s3, 45);
+    return result;
+}
+
+// Exact for values below 2^52, which is why the uniforms take 52 bits of each word
+__attribute__((target("avx2")))
+inline __m256d gen_u64_to_double_avx2(__m256i x) {
+    __m256d magic = _mm256_set1_pd(4503599627370496.0);
+    return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(x, _mm256_castpd_si256(magic))), magic);
+}
+
+__attribute__((target("avx2")))
+inline __m256d gen_log_avx2(__m256d u) {
+    __m256i bits = _mm256_castpd_si256(u);
+    __m256d e = _mm256_sub_pd(gen_u64_to_double_avx2(_mm256_srli_epi64(bits, 52)), _mm256_set1_pd(1023.0));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFll)),
+                                                    _mm256_set1_epi64x(0x3FF0000000000000ll)));
+    __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(GEN_SQRT2), _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    e = _mm256_blendv_pd(e, _mm256_add_pd(e, _mm256_set1_pd(1.0)), big);
+    __m256d f = _mm256_sub_pd(m, _mm256_set1_pd(1.0));
+    __m256d s = _mm256_div_pd(f, _mm256_add_pd(_mm256_set1_pd(2.0), f));
+    __m256d s2 = _mm256_mul_pd(s, s);
+    __m256d p = _mm256_set1_pd(1.0 / 17);
+    p = _mm256_add_pd(_mm256_mul_pd(p, s2), _mm256_set1_pd(1.0 / 15));
+    p = _mm256_add_pd(_mm256_mul_pd(p, s2), _mm256_set1_pd(1.0 / 13));
+    p = _mm256_add_pd(_mm256_mul_pd(p, s2), _mm256_set1_pd(1.0 / 11));
+    p = _mm256_add_pd(_mm256_mul_pd(p, s2), _mm256_set1_pd(1.0 / 9));
+    p = _mm256_add_pd(_mm256_mul_pd(p, s2), _mm256_set1_pd(1.0 / 7));
+    p = _mm256_add_pd(_mm256_mul_pd(p, s2), _mm256_set1_pd(1.0 / 5));
+    p = _mm256_add_pd(_mm256_mul_pd(p, s2), _mm256_set1_pd(1.0 / 3));
+    p = _mm256_mul_pd(p, s2);
+    __m256d two_s = _mm256_add_pd(s, s);
+    return _mm256_add_pd(_mm256_mul_pd(e, _mm256_set1_pd(GEN_LN2)), _mm256_add_pd(two_s, _mm256_mul_pd(two_s, p)));
+}
+
+__attribute__((target("avx2")))
+inline void gen_sincos_avx2(__m256d x, __m256d& sin_x, __m256d& cos_x) {
+    __m256d x2 = _mm256_mul_pd(x, x);
+    __m256d sp = _mm256_set1_pd(-1.0 / 355687428096000.0);
+    sp = _mm256_add_pd(_mm256_mul_pd(sp, x2), _mm256_set1_pd(1.0 / 1307674368000.0));
+    sp = _mm256_sub_pd(_mm256_mul_pd(sp, x2), _mm256_set1_pd(1.0 / 6227020800.0));
+    sp = _mm256_add_pd(_mm256_mul_pd(sp, x2), _mm256_set1_pd(1.0 / 39916800.0));
+    sp = _mm256_sub_pd(_mm256_mul_pd(sp, x2), _mm256_set1_pd(1.0 / 362880.0));
+    sp = _mm256_add_pd(_mm256_mul_pd(sp, x2), _mm256_set1_pd(1.0 / 5040.0));
+    sp = _mm256_sub_pd(_mm256_mul_pd(sp, x2), _mm256_set1_pd(1.0 / 120.0));
+    sp = _mm256_add_pd(_mm256_mul_pd(sp, x2), _mm256_set1_pd(1.0 / 6.0));
+    sin_x = _mm256_sub_pd(x, _mm256_mul_pd(_mm256_mul_pd(x, x2), sp));
+    __m256d cp = _mm256_set1_pd(1.0 / 20922789888000.0);
+    cp = _mm256_sub_pd(_mm256_mul_pd(cp, x2), _mm256_set1_pd(1.0 / 87178291200.0));
+    cp = _mm256_add_pd(_mm256_mul_pd(cp, x2), _mm256_set1_pd(1.0 / 479001600.0));
+    cp = _mm256_sub_pd(_mm256_mul_pd(cp, x2), _mm256_set1_pd(1.0 / 3628800.0));
+    cp = _mm256_add_pd(_mm256_mul_pd(cp, x2), _mm256_set1_pd(1.0 / 40320.0));
+    cp = _mm256_sub_pd(_mm256_mul_pd(cp, x2), _mm256_set1_pd(1.0 / 720.0));
+    cp = _mm256_add_pd(_mm256_mul_pd(cp, x2), _mm256_set1_pd(1.0 / 24.0));
+    cp = _mm256_sub_pd(_mm256_mul_pd(cp, x2), _mm256_set1_pd(0.5));
+    cos_x = _mm256_add_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(x2, cp));
+}
+
+__attribute__((target("avx2")))
+inline void gen_box_muller_avx2(__m256i w1, __m256i w2, double* z0, double* z1) {
+    __m256d scale = _mm256_set1_pd(GEN_TWO_POW_M52);
+    __m256d u1 = _mm256_sub_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(gen_u64_to_double_avx2(_mm256_srli_epi64(w1, 12)), scale));
+    __m256d u2 = _mm256_mul_pd(gen_u64_to_double_avx2(_mm256_srli_epi64(w2, 12)), scale);
+    __m256d r = _mm256_sqrt_pd(_mm256_mul_pd(_mm256_set1_pd(-2.0), gen_log_avx2(u1)));
+    __m256d s, c;
+    gen_sincos_avx2(_mm256_mul_pd(u2, _mm256_set1_pd(GEN_HALF_PI)), s, c);
+    __m256i sign0 = _mm256_slli_epi64(_mm256_and_si256(w2, _mm256_set1_epi64x(1)), 63);
+    __m256i sign1 = _mm256_slli_epi64(_mm256_and_si256(w2, _mm256_set1_epi64x(2)), 62);
+    _mm256_storeu_pd(z0, _mm256_xor_pd(_mm256_mul_pd(r, c), _mm256_castsi256_pd(sign0)));
+    _mm256_storeu_pd(z1, _mm256_xor_pd(_mm256_mul_pd(r, s), _mm256_castsi256_pd(sign1)));
+}
+
+__attribute__((target("avx2")))
+inline void gen_step_avx2(uint64_t s[4][GEN_LANES], double out[GEN_BLOCK]) {
+    for (int half = 0; half < GEN_LANES; half += 4) {
+        __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&s[0][half]));
+        __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&s[1][half]));
+        __m256i s2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&s[2][half]));
+        __m256i s3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&s[3][half]));
+        __m256i w1 = gen_next_avx2(s0, s1, s2, s3);
+        __m256i w2 = gen_next_avx2(s0, s1, s2, s3);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&s[0][half]), s0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&s[1][half]), s1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&s[2][half]), s2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&s[3][half]), s3);
+        gen_box_muller_avx2(w1, w2, out + half, out + GEN_LANES + half);
+    }
+}
+
+// ---------------------------------------- AVX-512 (all 8 lanes in one register) ----------------------------------------
+// GCC's unmasked shifts, rotates and sqrt pass an _mm512_undefined_*() source that -Wuninitialized reports
+// (at link time with LTO). Their maskz forms with every lane selected are the same instructions with a
+// zeroed source.
+#define GEN_ALL_LANES ((__mmask8)0xFF)
+
+__attribute__((target("avx512f")))
+inline __m512i gen_next_avx512(__m512i& s0, __m512i& s1, __m512i& s2, __m512i& s3) {
+    __m512i x = _mm512_add_epi64(_mm512_maskz_slli_epi64(GEN_ALL_LANES, s1, 2), s1);
+    x = _mm512_maskz_rol_epi64(GEN_ALL_LANES, x, 7);
+    __m512i result = _mm512_add_epi64(_mm512_maskz_slli_epi64(GEN_ALL_LANES, x, 3), x);
+    __m512i t = _mm512_maskz_slli_epi64(GEN_ALL_LANES, s1, 17);
+    s2 = _mm512_xor_si512(s2, s0);
+    s3 = _mm512_xor_si512(s3, s1);
+    s1 = _mm512_xor_si512(s1, s2);
+    s0 = _mm512_xor_si512(s0, s3);
+    s2 = _mm512_xor_si512(s2, t);
+    s3 = _mm512_maskz_rol_epi64(GEN_ALL_LANES, s3, 45);
+    return result;
+}
+
+__attribute__((target("avx512f")))
+inline __m512d gen_u64_to_double_avx512(__m512i x) {
+    __m512d magic = _mm512_set1_pd(4503599627370496.0);
+    return _mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(x, _mm512_castpd_si512(magic))), magic);
+}
+
+__attribute__((target("avx512f")))
+inline __m512d gen_log_avx512(__m512d u) {
+    __m512i bits = _mm512_castpd_si512(u);
+    __m512d e = _mm512_sub_pd(gen_u64_to_double_avx512(_mm512_maskz_srli_epi64(GEN_ALL_LANES, bits, 52)), _mm512_set1_pd(1023.0));
+    __m512d m = _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi64(0x000FFFFFFFFFFFFFll)),
+                                                    _mm512_set1_epi64(0x3FF0000000000000ll)));
+    __mmask8 big = _mm512_cmp_pd_mask(m, _mm512_set1_pd(GEN_SQRT2), _CMP_GT_OQ);
+    m = _mm512_mask_mul_pd(m, big, m, _mm512_set1_pd(0.5));
+    e = _mm512_mask_add_pd(e, big, e, _mm512_set1_pd(1.0));
+    __m512d f = _mm512_sub_pd(m, _mm512_set1_pd(1.0));
+    __m512d s = _mm512_div_pd(f, _mm512_add_pd(_mm512_set1_pd(2.0), f));
+    __m512d s2 = _mm512_mul_pd(s, s);
+    __m512d p = _mm512_set1_pd(1.0 / 17);
+    p = _mm512_add_pd(_mm512_mul_pd(p, s2), _mm512_set1_pd(1.0 / 15));
+    p = _mm512_add_pd(_mm512_mul_pd(p, s2), _mm512_set1_pd(1.0 / 13));
+    p = _mm512_add_pd(_mm512_mul_pd(p, s2), _mm512_set1_pd(1.0 / 11));
+    p = _mm512_add_pd(_mm512_mul_pd(p, s2), _mm512_set1_pd(1.0 / 9));
+    p = _mm512_add_pd(_mm512_mul_pd(p, s2), _mm512_set1_pd(1.0 / 7));
+    p = _mm512_add_pd(_mm512_mul_pd(p, s2), _mm512_set1_pd(1.0 / 5));
+    p = _mm512_add_pd(_mm512_mul_pd(p, s2), _mm512_set1_pd(1.0 / 3));
+    p = _mm512_mul_pd(p, s2);
+    __m512d two_s = _mm512_add_pd(s, s);
+    return _mm512_add_pd(_mm512_mul_pd(e, _mm512_set1_pd(GEN_LN2)), _mm512_add_pd(two_s, _mm512_mul_pd(two_s, p)));
+}
+
+__attribute__((target("avx512f")))
+inline void gen_sincos_avx512(__m512d x, __m512d& sin_x, __m512d& cos_x) {
+    __m512d x2 = _mm512_mul_pd(x, x);
+    __m512d sp = _mm512_set1_pd(-1.0 / 355687428096000.0);
+    sp = _mm512_add_pd(_mm512_mul_pd(sp, x2), _mm512_set1_pd(1.0 / 1307674368000.0));
+    sp = _mm512_sub_pd(_mm512_mul_pd(sp, x2), _mm512_set1_pd(1.0 / 6227020800.0));
+    sp = _mm512_add_pd(_mm512_mul_pd(sp, x2), _mm512_set1_pd(1.0 / 39916800.0));
+    sp = _mm512_sub_pd(_mm512_mul_pd(sp, x2), _mm512_set1_pd(1.0 / 362880.0));
+    sp = _mm512_add_pd(_mm512_mul_pd(sp, x2), _mm512_set1_pd(1.0 / 5040.0));
+    sp = _mm512_sub_pd(_mm512_mul_pd(sp, x2), _mm512_set1_pd(1.0 / 120.0));
+    sp = _mm512_add_pd(_mm512_mul_pd(sp, x2), _mm512_set1_pd(1.0 / 6.0));
+    sin_x = _mm512_sub_pd(x, _mm512_mul_pd(_mm512_mul_pd(x, x2), sp));
+    __m512d cp = _mm512_set1_pd(1.0 / 20922789888000.0);
+    cp = _mm512_sub_pd(_mm512_mul_pd(cp, x2), _mm512_set1_pd(1.0 / 87178291200.0));
+    cp = _mm512_add_pd(_mm512_mul_pd(cp, x2), _mm512_set1_pd(1.0 / 479001600.0));
+    cp = _mm512_sub_pd(_mm512_mul_pd(cp, x2), _mm512_set1_pd(1.0 / 3628800.0));
+    cp = _mm512_add_pd(_mm512_mul_pd(cp, x2), _mm512_set1_pd(1.0 / 40320.0));
+    cp = _mm512_sub_pd(_mm512_mul_pd(cp, x2), _mm512_set1_pd(1.0 / 720.0));
+    cp = _mm512_add_pd(_mm512_mul_pd(cp, x2), _mm512_set1_pd(1.0 / 24.0));
+    cp = _mm512_sub_pd(_mm512_mul_pd(cp, x2), _mm512_set1_pd(0.5));
+    cos_x = _mm512_add_pd(_mm512_set1_pd(1.0), _mm512_mul_pd(x2, cp));
+}
+
+__attribute__((target("avx512f")))
+inline void gen_step_avx512(uint64_t s[4][GEN_LANES], double out[GEN_BLOCK]) {
+    __m512i s0 = _mm512_loadu_si512(&s[0][0]);
+    __m512i s1 = _mm512_loadu_si512(&s[1][0]);
+    __m512i s2 = _mm512_loadu_si512(&s[2][0]);
+    __m512i s3 = _mm512_loadu_si512(&s[3][0]);
+    __m512i w1 = gen_next_avx512(s0, s1, s2, s3);
+    __m512i w2 = gen_next_avx512(s0, s1, s2, s3);
+    _mm512_storeu_si512(&s[0][0], s0);
+    _mm512_storeu_si512(&s[1][0], s1);
+    _mm512_storeu_si512(&s[2][0], s2);
+    _mm512_storeu_si512(&s[3][0], s3);
+
+    __m512d scale = _mm512_set1_pd(GEN_TWO_POW_M52);
+    __m512d u1 = _mm512_sub_pd(_mm512_set1_pd(1.0), _mm512_mul_pd(gen_u64_to_double_avx512(_mm512_maskz_srli_epi64(GEN_ALL_LANES, w1, 12)), scale));
+    __m512d u2 = _mm512_mul_pd(gen_u64_to_double_avx512(_mm512_maskz_srli_epi64(GEN_ALL_LANES, w2, 12)), scale);
+    __m512d r = _mm512_maskz_sqrt_pd(GEN_ALL_LANES, _mm512_mul_pd(_mm512_set1_pd(-2.0), gen_log_avx512(u1)));
+    __m512d sn, cs;
+    gen_sincos_avx512(_mm512_mul_pd(u2, _mm512_set1_pd(GEN_HALF_PI)), sn, cs);
+    __m512i sign0 = _mm512_maskz_slli_epi64(GEN_ALL_LANES, _mm512_and_si512(w2, _mm512_set1_epi64(1)), 63);
+    __m512i sign1 = _mm512_maskz_slli_epi64(GEN_ALL_LANES, _mm512_and_si512(w2, _mm512_set1_epi64(2)), 62);
+    _mm512_storeu_pd(out, _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(_mm512_mul_pd(r, cs)), sign0)));
+    _mm512_storeu_pd(out + GEN_LANES, _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(_mm512_mul_pd(r, sn)), sign1)));
+}
+
+// ---------------------------------------- Generator ----------------------------------------
+
+// Best implementation this CPU supports
+inline int gen_detect_isa() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return GEN_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return GEN_AVX2;
+    }
+    return GEN_SCALAR;
+}
+
+inline const char* gen_isa_name(int isa) {
+    return isa == GEN_AVX512 ? "avx512" : isa == GEN_AVX2 ? "avx2" : "scalar";
+}
+
+// Parse a --isa value ("auto" picks the best). Returns -1 if it isn't one or the CPU lacks it.
+inline int gen_parse_isa(const char* name) {
+    int best = gen_detect_isa();
+    int isa = -1;
+    if (strcmp(name, "auto") == 0) {
+        isa = best;
+    } else if (strcmp(name, "scalar") == 0) {
+        isa = GEN_SCALAR;
+    } else if (strcmp(name, "avx2") == 0) {
+        isa = GEN_AVX2;
+    } else if (strcmp(name, "avx512") == 0) {
+        isa = GEN_AVX512;
+    }
+    return isa > best ? -1 : isa;
+}
+
+// Standard normal samples, produced a block at a time
+class GaussianGenerator {
+public:
+    GaussianGenerator(uint64_t seed, int isa) : isa_(isa), used_(GEN_BLOCK) {
+        uint64_t x = seed;
+        for (int k = 0; k < 4; k++) {
+            for (int i = 0; i < GEN_LANES; i++) {
+                state_[k][i] = gen_splitmix64(x);
+            }
+        }
+    }
+
+    // Fill out[0..n) with N(0, 1) samples
+    void fill(double* out, int n) {
+        int done = 0;
+        // Leftovers of the last block first
+        while (done < n && used_ < GEN_BLOCK) {
+            out[done++] = block_[used_++];
+        }
+        // Whole blocks straight into the output
+        while (n - done >= GEN_BLOCK) {
+            step(out + done);
+            done += GEN_BLOCK;
+        }
+        if (done < n) {
+            step(block_);
+            used_ = 0;
+            while (done < n) {
+                out[done++] = block_[used_++];
+            }
+        }
+    }
+
+    double next() {
+        double z;
+        fill(&z, 1);
+        return z;
+    }
+
+    int isa() const { return isa_; }
+
+private:
+    void step(double out[GEN_BLOCK]) {
+        if (isa_ == GEN_AVX512) {
+            gen_step_avx512(state_, out);
+        } else if (isa_ == GEN_AVX2) {
+            gen_step_avx2(state_, out);
+        } else {
+            gen_step_scalar(state_, out);
+        }
+    }
+
+    int isa_;
+    uint64_t state_[4][GEN_LANES];
+    double block_[GEN_BLOCK];
+    int used_;              // Samples of block_ already handed out
+};
+
+#pragma GCC pop_options
+
+#endif
@@ -3,7 +3,6 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
-#include <random>
 #include <unistd.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -17,249 +16,513 @@
 #include <cctype>
 // #include <ctime>
 #include <queue>
+#include <vector>
+#include <sstream>
+
+#include "shared_buffer.h"
+#include "shm_backend.h"
+#include "async_log.h"
+#include "cpu_affinity.h"
+#include "timer_wheel.h"
+#include "price_gen.h"
+#include "pacer.h"
+#include <atomic>
+#include <thread>
+
+// Record in each tick how long it waited between generation and enqueue (mostly the semaphore waits)
+void stamp_enqueue(Tick ticks[], int n) {
+    uint32_t now = monotonic_us();
+    for (int i = 0; i < n; i++) {
+        ticks[i].enqueue_lag = lag_encode(now - ticks[i].ts_us);
+    }
+}
 
-#define MAX_COMMODITIES 11
-#define Max_Buffer_size 40
-
-// Structure for shared memory
-struct SharedBuffer {
-    double prices[MAX_COMMODITIES][5];        // Current prices saved to calc average
-    int write_index[MAX_COMMODITIES];         // Write index for circular buffer to allow continous addition of prices.           
-    double buffer_prices[Max_Buffer_size];      // Pointer to array for prices (inside shared memory)
-    double buffer_comm_index[Max_Buffer_size];  // Pointer to array for commodity indexes (inside shared memory)
-    int front;               // Front of the queue
-    int rear;                // Rear of the queue
-    int count;               // Number of elements in the buffer
-    int buffer_size;         // Buffer size
-};
+ShmSegment segment;
+SharedBuffer *shared_buffer = nullptr;
+std::atomic<int>* producer_entry = nullptr;    // Our pid in the segment, so a consumer exiting knows we still use it
+ProducerMetrics* metrics = nullptr;            // Our counters in the segment, for ./stats
+AsyncLogger logger;
+const char* symbol_names[MAX_SYMBOLS];      // Log names of the symbol ids, in the segment's registry
+
+// Streams mode: requested and achieved rate, reported on exit (single mode has them from its Pacer)
+double requested_rate = 0;
+uint64_t rate_start_ns = 0;
+std::atomic<uint64_t> ticks_sent(0);
+
+// Place n ticks on the shared buffer with the consumer's transport. Safe to call from several threads.
+// source is the commodity index used for the log records.
+void publish_batch(Tick ticks[], int n, int source) {
+    bool semaphores = shared_buffer->header.transport == TRANSPORT_SEMAPHORE;
+    if (semaphores) {
+        logger.log(LOG_DEBUG, EV_MUTEX_WAIT, source);
+    }
+    uint64_t entered_ns = 0;    // Logged once the mutex is released
+    // Readers of the last-value cache see the prices before the queue can make us wait
+    publish_ticks(shared_buffer, ticks, n, metrics, [&](int first, int count) {
+        if (semaphores && logger.enabled(LOG_DEBUG)) {
+            entered_ns = log_clock();
+        }
+        stamp_enqueue(ticks + first, count);
+    });
+    if (semaphores) {
+        logger.log(LOG_DEBUG, EV_MUTEX_ENTERED, source, 0, entered_ns);
+        logger.log(LOG_DEBUG, EV_MUTEX_EXITED, source);
+    }
 
-// Push values into the buffer
-void push(SharedBuffer* sb, int price, int comm_index) {
-    if (sb->count < sb->buffer_size) {
-        sb->buffer_prices[sb->rear] = price;
-        sb->buffer_comm_index[sb->rear] = comm_index;
-        sb->rear = (sb->rear + 1) % sb->buffer_size;  // Wrap around
-        sb->count++;
-    } else {
-        std::cerr << "Buffer is full! Cannot push.\n";
+    // Log placing values
+    if (logger.enabled(LOG_INFO)) {
+        for (int i = 0; i < n; i++) {
+            logger.log(LOG_INFO, EV_PLACED, ticks[i].comm_index, ticks[i].price);
+        }
     }
 }
 
-
-const char* predefined_commodities[MAX_COMMODITIES] = {
-    "ALUMINIUM",
-    "COPPER",
-    "COTTON",
-    "CRUDEOIL",
-    "GOLD",
-    "LEAD",
-    "MENTHAOIL",
-    "NATURAL GAS",
-    "NICKEL",
-    "SILVER",
-    "ZINC"
+// ---------------------------------------- Multi-stream mode ----------------------------------------
+
+#define WHEEL_TICK_NS 100000    // Timer wheel slot width (100 us)
+#define WHEEL_SLOTS 4096        // Slots per turn (~0.4 s), slower streams wait for their turn
+#define MAX_CATCH_UP 1000       // Most ticks a late stream generates at once before it drops its backlog
+
+// One simulated feed from the --streams file
+struct Stream {
+    std::string name;
+    int comm_index;             // Symbol id, registered once attached
+    double rate;                // Ticks per second
+    uint64_t period_ns;
+    uint64_t next_ns;           // When the next tick is due
+    uint8_t seq;
+    double mean;
+    double std_dev;
 };
 
-int get_commodity_index(std::string comm){
-    // Convert string to uppercase
-      std::transform(comm.begin(), comm.end(), comm.begin(),
-                   [](unsigned char c) { return std::toupper(c); });
-
-
-        for (int i = 0 ; i < MAX_COMMODITIES; i++){
-            if (predefined_commodities[i] == comm){
-                return i;
-            }
+// Read "COMMODITY MEAN STD_DEV RATE" lines ('#' starts a comment). Returns false after printing the error.
+bool load_streams(const char* path, std::vector<Stream>& streams) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: cannot open streams file " << path << ".\n";
+        return false;
+    }
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
         }
-        return -1;
-    };
-
-//  Get formatted current time
-std::string get_time() {
-    timespec ts;
-    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
-        perror("error in clock_gettime");
-        exit(EXIT_FAILURE);
+        std::istringstream fields(line);
+        std::string name;
+        double mean, std_dev, rate;
+        if (!(fields >> name)) {
+            continue;   // Blank line
+        }
+        if (!(fields >> mean >> std_dev >> rate) || rate <= 0 || std_dev < 0) {
+            std::cerr << "Error: " << path << ":" << line_number << ": expected COMMODITY MEAN STD_DEV RATE (rate > 0).\n";
+            return false;
+        }
+        Stream stream;
+        char normalized[SYMBOL_NAME_SIZE];
+        if (!symbol_normalize(name, normalized)) {
+            std::cerr << "Error: " << path << ":" << line_number << ": invalid commodity name " << name << ".\n";
+            return false;
+        }
+        stream.name = name;
+        stream.comm_index = -1;
+        stream.rate = rate;
+        stream.period_ns = (uint64_t)(1e9 / rate);
+        if (stream.period_ns == 0) {
+            stream.period_ns = 1;
+        }
+        stream.next_ns = 0;
+        stream.seq = 0;
+        stream.mean = mean;
+        stream.std_dev = std_dev;
+        streams.push_back(stream);
     }
-
-    char time_str[30]; // Format: [MM/DD/YYYY HH:MM:SS.SSS]
-    strftime(time_str, sizeof(time_str), "[%m/%d/%Y %H:%M:%S.", localtime(&ts.tv_sec));
-    snprintf(time_str + strlen(time_str), sizeof(time_str) - strlen(time_str), ".%03ld", ts.tv_nsec / 1000000); // to convert from nano second to ms divide by 10^6
-    return std::string(time_str);
+    if (streams.empty()) {
+        std::cerr << "Error: no streams in " << path << ".\n";
+        return false;
+    }
+    return true;
 }
 
-int shm_id;
-SharedBuffer *shared_buffer = nullptr;
+// Worker thread: drives its share of the streams from a timer wheel and places every tick that came due
+// in one pass with as few pushes as possible (batch_size ticks at most per push).
+// The prices of a pass are drawn together, one block fill for every stream that came due.
+// With poisson the gaps of every stream are exponential around its period.
+void stream_worker(std::vector<Stream>* streams, std::vector<int> ids, int batch_size, uint64_t seed, int isa, bool poisson) {
+    GaussianGenerator generator(seed, isa);
+    uint64_t start = log_clock();
+    TimerWheel wheel(WHEEL_TICK_NS, WHEEL_SLOTS, start);
+    uint64_t spread = seed;
+    for (size_t i = 0; i < ids.size(); i++) {
+        Stream& s = (*streams)[ids[i]];
+        s.next_ns = start + gen_splitmix64(spread) % s.period_ns;     // Spread the first ticks out
+        wheel.schedule(ids[i], s.next_ns);
+    }
+    std::vector<Tick> pending;
+    std::vector<int> owners;        // Stream of each pending tick
+    std::vector<double> normals;
+
+    while (!wait_stopping()) {
+        uint64_t now = log_clock();
+        uint32_t now_us = monotonic_us();
+        wheel.advance(now, [&](int id) {
+            Stream& s = (*streams)[id];
+            int made = 0;
+            while (s.next_ns <= now && made < MAX_CATCH_UP) {
+                Tick tick;
+                tick.ts_us = now_us;
+                tick.seq = s.seq++;
+                tick.comm_index = s.comm_index;
+                tick.enqueue_lag = 0;
+                pending.push_back(tick);
+                owners.push_back(id);
+                s.next_ns += poisson ? (uint64_t)pace_exponential_ns(spread, s.period_ns) : s.period_ns;
+                made++;
+            }
+            if (s.next_ns <= now) {
+                s.next_ns = now + s.period_ns;     // Too far behind, drop the backlog rather than burst
+            }
+            wheel.schedule(id, s.next_ns);
+        });
+
+        ticks_sent.fetch_add(pending.size(), std::memory_order_relaxed);
+        normals.resize(pending.size());
+        generator.fill(normals.data(), (int)normals.size());
+        for (size_t i = 0; i < pending.size(); i++) {
+            const Stream& s = (*streams)[owners[i]];
+            pending[i].price = s.mean + s.std_dev * normals[i];
+            logger.log(LOG_INFO, EV_GENERATED, s.comm_index, pending[i].price);
+        }
 
+        for (size_t done = 0; done < pending.size(); done += batch_size) {
+            int n = (int)std::min(pending.size() - done, (size_t)batch_size);
+            publish_batch(pending.data() + done, n, pending[done].comm_index);
+        }
+        pending.clear();
+        owners.clear();
 
-// Semaphore operations
-// Decrease the semaphore value 
-void semWait(int semid) {
-    struct sembuf sop = {0, -1, 0};
-    if (semop(semid, &sop, 1) == -1) {
-        perror("semWait failed");
-        exit(EXIT_FAILURE);
+        // Sleep until the next slot that has a stream due
+        pace_sleep_until(wheel.next_ns());
     }
 }
 
-// Increase the semaphore value 
-void semSignal(int semid) {
-    struct sembuf sop = {0, 1, 0};
-    if (semop(semid, &sop, 1) == -1) {
-        perror("semSignal failed");
-        exit(EXIT_FAILURE);
+// pacer: the single mode's, nullptr in streams mode
+void print_run_report(const Pacer* pacer) {
+    WaitCounters& waits = wait_counters();
+    if (waits.spun.load() + waits.yielded.load() + waits.blocked.load() > 0) {
+        printf("Waits for the buffer (%s): %llu spun, %llu yielded, %llu blocked.\n", wait_strategy_name(wait_strategy()),
+               (unsigned long long)waits.spun.load(), (unsigned long long)waits.yielded.load(), (unsigned long long)waits.blocked.load());
+    }
+    double requested = pacer ? pacer->requested_rate() : requested_rate;
+    if (requested <= 0) {
+        return;
+    }
+    uint64_t sent = pacer ? pacer->sent() : ticks_sent.load();
+    double elapsed = (pacer ? pacer->elapsed_ns() : pace_clock() - rate_start_ns) / 1e9;
+    double achieved = pacer ? pacer->achieved_rate() : (elapsed > 0 ? sent / elapsed : 0);
+    printf("Requested %.0f ticks/sec, achieved %.0f ticks/sec (%.2f%%), %llu ticks over %.1f s.\n",
+           requested, achieved, 100.0 * achieved / requested, (unsigned long long)sent, elapsed);
+    if (pacer && pacer->skipped() > 0) {
+        printf("%llu ticks skipped after stalls longer than the burst, worst %.1f us behind.\n",
+               (unsigned long long)pacer->skipped(), pacer->max_late_ns() / 1000.0);
     }
 }
 
+
+// Only asks every loop and wait to stop, main shuts down once they have
 void handle_sigint(int sig) {
-    if (shared_buffer) {
-        // Detach from shared memory
-        if (shmdt(shared_buffer) == -1) {
-            perror("Failed to detach shared memory");
-        } else {
-            printf("Shared memory detached successfully.\n");
-        }
-    }
+    (void)sig;
+    wait_request_stop();
+}
+
+// Run from main after the generating threads returned
+void shutdown(const Pacer* pacer) {
+    // Write out the queued log records
+    logger.stop();
+
+    print_run_report(pacer);
 
-    exit(0); // Terminate program
+    // Detach from shared memory
+    producer_unregister(producer_entry);
+    shm_detach(segment);
 }
 
 
 int main(int argc, char *argv[]) {
-    if (argc != 6) {
-        std::cerr << "Error not enough arguments passed.\nUsage: ./producer <COMMODITY_NAME> <MEAN> <STD_DEV> <SLEEP_MS> <BUFFER_SIZE>\n";
+    // Several streams from a file, or one commodity given on the command line
+    bool streams_mode = argc >= 3 && strcmp(argv[1], "--streams") == 0;
+    if (argc < 5 && !streams_mode) {
+        std::cerr << "Error not enough arguments passed.\nUsage: ./producer <COMMODITY_NAME> <MEAN> <STD_DEV> <SLEEP_MS> [--batch N] [--log-level off|info|debug] [--seed N]\n"
+                     "                  [--isa auto|scalar|avx2|avx512] [--rate TICKS_PER_SEC] [--burst N] [--poisson]\n"
+                     "                  [--cpu LIST] [--numa-node N]   (--cpu: one CPU per thread in turn)\n"
+                     "                  [--wait spin|pause|yield|block|adaptive]\n"
+                     "                  [--shm NAME] [--hugepages] [--prefault]   (SLEEP_MS may be fractional, 0 for no pause; --rate replaces it)\n"
+                     "       ./producer --streams FILE [--threads N] [--batch N] [--poisson] [options]   (FILE lines: COMMODITY MEAN STD_DEV RATE_PER_SEC)\n";
         return 1;
     }
     signal(SIGINT, handle_sigint);
 
     // Parse command-line arguments
-    std::string commodity_name = argv[1];
-    int comm_index = get_commodity_index(commodity_name); 
-    if (comm_index == -1){
-        std::cerr << "Error Invalid Commodity name.\nMust enter one of these:\n\nALUMINIUM\nCOPPER\nCOTTON\nCRUDEOIL\nGOLD\nLEAD\nMENTHAOIL\nNATURAL_GAS\nNICKEL\nSILVER\nZINC\n";
-        return 1;
-    }
-    
-    double mean = std::stod(argv[2]);
-    double std_dev = std::stod(argv[3]);
-    int sleep_interval = std::stoi(argv[4]);
-    int buffer_size = std::stoi(argv[5]);
+    std::string commodity_name;
+    int comm_index = -1;
+    double mean = 0;
+    double std_dev = 0;
+    double sleep_interval = 0;
+    std::vector<Stream> streams;
+    if (streams_mode) {
+        if (!load_streams(argv[2], streams)) {
+            return 1;
+        }
+    } else {
+        commodity_name = argv[1];
+        char normalized[SYMBOL_NAME_SIZE];
+        if (!symbol_normalize(commodity_name, normalized)) {
+            std::cerr << "Error Invalid Commodity name, must be up to " << SYMBOL_NAME_SIZE - 1
+                      << " letters, digits, spaces or _ . - / (ALUMINIUM, COPPER, NATURAL_GAS, ...).\n";
+            return 1;
+        }
 
-   
-    // Generate unique key for shared memory and semaphores
- 
-    key_t sharedm_key = ftok("consumer", 65); // uses same consumer key to access the shared memory
-    if (sharedm_key == -1) {
-        perror("Failed to generate shared memory key in the Producer");
-        return 1;
+        mean = std::stod(argv[2]);
+        std_dev = std::stod(argv[3]);
+        sleep_interval = std::stod(argv[4]);
     }
-    
-
-    // Check if shared memory exists
-    shm_id = shmget(sharedm_key, sizeof(SharedBuffer) , 0666); // Doesnt create the shared memory if doesnt exist
-    if (shm_id == -1) {
-        if (errno == ENOENT) {
-            std::cerr << "Error: Shared memory does not exist. Please run the consumer first to create shared memory.\n";
+    int batch_size = streams_mode ? 0 : 1; // Prices generated and placed per critical section, then sleep once (streams: most per push, 0 for up to the buffer size)
+    int threads = 1;
+    double rate = -1;       // Ticks per second, -1 to derive it from SLEEP_MS
+    int burst = 0;          // Token bucket depth, 0 for one batch
+    bool poisson = false;
+    int log_level = LOG_INFO;
+    bool seeded = false;
+    uint64_t seed = 0;
+    int isa = gen_detect_isa();
+    std::vector<int> cpus;      // Main thread or stream workers take one each in turn
+    int numa_node = -1;
+    int wait = WAIT_ADAPTIVE;
+    ShmOptions shm_options;
+    for (int i = streams_mode ? 3 : 5; i < argc; ) {
+        int used = shm_parse_option(shm_options, argc, argv, i);
+        if (used > 0) {
+            i += used;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_size = std::stoi(argv[i + 1]);
+            i += 2;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = std::stoull(argv[i + 1]);
+            seeded = true;
+            i += 2;
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            if (!parse_cpu_list(argv[i + 1], cpus)) {
+                std::cerr << "Error Invalid CPU list " << argv[i + 1] << ", must be like 3 or 0-3,8.\n";
+                return 1;
+            }
+            i += 2;
+        } else if (strcmp(argv[i], "--numa-node") == 0 && i + 1 < argc) {
+            numa_node = std::stoi(argv[i + 1]);
+            i += 2;
+        } else if (strcmp(argv[i], "--wait") == 0 && i + 1 < argc) {
+            wait = wait_parse_strategy(argv[i + 1]);
+            if (wait == -1) {
+                std::cerr << "Error Invalid wait strategy " << argv[i + 1] << ", must be spin, pause, yield, block or adaptive.\n";
+                return 1;
+            }
+            i += 2;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc && !streams_mode) {
+            rate = std::stod(argv[i + 1]);
+            i += 2;
+        } else if (strcmp(argv[i], "--burst") == 0 && i + 1 < argc && !streams_mode) {
+            burst = std::stoi(argv[i + 1]);
+            i += 2;
+        } else if (strcmp(argv[i], "--poisson") == 0) {
+            poisson = true;
+            i += 1;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc && streams_mode) {
+            threads = std::stoi(argv[i + 1]);
+            i += 2;
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            isa = gen_parse_isa(argv[i + 1]);
+            if (isa == -1) {
+                std::cerr << "Error Invalid instruction set " << argv[i + 1] << ", must be auto, scalar, avx2 or avx512 (and supported by this CPU).\n";
+                return 1;
+            }
+            i += 2;
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            log_level = log_parse_level(argv[i + 1]);
+            if (log_level == -1) {
+                std::cerr << "Error Invalid log level " << argv[i + 1] << ", must be off, info or debug.\n";
+                return 1;
+            }
+            i += 2;
         } else {
-            perror("Failed to access shared memory for the producer.");
+            std::cerr << "Error unknown option " << argv[i] << ".\n";
+            return 1;
         }
-        return 1;
     }
 
-      // Attach to the existing shared memory
-    shared_buffer = (SharedBuffer *)shmat(shm_id, nullptr, 0);
-    if (shared_buffer == (void *)-1) {
-        perror("Failed to attach to shared memory from the producer.");
+   
+    if (sleep_interval < 0) {
+        std::cerr << "Error Invalid sleep interval, must be 0 or more milliseconds.\n";
         return 1;
     }
-     if (buffer_size != shared_buffer->buffer_size){
-        perror("Invalid Buffer size, buffer size entered is not the same as consumer");
+    if (rate < 0 && rate != -1) {
+        std::cerr << "Error Invalid rate, must be 0 (unpaced) or more ticks per second.\n";
         return 1;
     }
-
-    // Getting semaphore keys from the consumer
-    key_t sem_mutex_key = ftok("consumer", 70);
-    key_t sem_filled_key = ftok("consumer", 71);
-    key_t sem_available_key = ftok("consumer", 72);
-    if(sem_mutex_key == -1 || sem_filled_key == -1 || sem_available_key == -1){
-        perror("Failed to generate semaphore keys in the producer.");
+    if (burst < 0) {
+        std::cerr << "Error Invalid burst, must be 1 or more ticks.\n";
         return 1;
     }
-    
-    // Getting the created mutex semaphore
-    int sem_mutex_id =  semget(sem_mutex_key, 1, 0666);
-    if (sem_mutex_id == -1) {
-        if (errno == ENOENT) {
-            std::cerr << "Error: (Mutex) semaphore does not exist. Please run the consumer first to create semaphores.\n";
-        } else {
-            perror("Failed to get (mutex) semaphore for the producer.");
-        }
+    if (threads < 1 || threads > (int)streams.size() + (streams_mode ? 0 : 1)) {
+        std::cerr << "Error Invalid thread count, must be between 1 and the number of streams.\n";
         return 1;
     }
-    
-    // Getting the created filled semaphore
-    int sem_filled_id = semget(sem_filled_key, 1, 0666);
-    if (sem_filled_id == -1) {
-        if (errno == ENOENT) {
-            std::cerr << "Error: (Filled) semaphore does not exist. Please run the consumer first to create semaphores.\n";
-        } else {
-            perror("Failed to get (filled) semaphore for the producer.");
+    if (numa_node != -1) {
+        // Run on the node (unless --cpu says where) and keep generator state and batches in its memory
+        std::vector<int> node_cpus;
+        if (!numa_node_cpus(numa_node, node_cpus)) {
+            std::cerr << "Error Invalid NUMA node, must be one with CPUs between 0 and " << numa_node_count() - 1 << ".\n";
+            return 1;
         }
+        if ((cpus.empty() && !pin_to_cpus(node_cpus)) || !numa_prefer(numa_node)) {
+            return 1;
+        }
+    }
+    if (!cpus.empty() && !pin_to_cpus(cpus)) {
         return 1;
     }
-    
-    // Getting the created available semaphore
-    int sem_available_id = semget(sem_available_key, 1, 0666);
-    if (sem_available_id == -1) {
-        if (errno == ENOENT) {
-            std::cerr << "Error: (Available) semaphore does not exist. Please run the consumer first to create semaphores.\n";
-        } else {
-            perror("Failed to get (available) semaphore for the producer.");
-        }
+    wait_set_strategy(wait);    // After pinning, adaptive looks at the CPUs left to it
+
+    // Attach to the shared memory created by the consumer
+    if (!shm_attach(shm_options, segment)) {
+        return 1;
+    }
+    shared_buffer = (SharedBuffer *)segment.addr;
+
+    // Refuse to run against a segment laid out by a different build
+    const char* layout_error = header_check(shared_buffer, segment.size);
+    if (layout_error) {
+        std::cerr << "Error: " << layout_error << ".\n";
+        return 1;
+    }
+    producer_entry = producer_register(shared_buffer);
+    metrics = producer_metrics(shared_buffer, producer_entry);
+    if (!cpus.empty() || numa_node != -1) {
+        print_placement(numa_node, segment.addr, segment.size);
+    }
+    // The capacity comes from the consumer
+    if (streams_mode && batch_size == 0) {
+        batch_size = std::min(shared_buffer->header.buffer_size, MAX_BATCH);
+    }
+    if (batch_size < 1 || batch_size > shared_buffer->header.buffer_size) {
+        std::cerr << "Error Invalid batch size, must be between 1 and the buffer size (" << shared_buffer->header.buffer_size << ").\n";
         return 1;
     }
-    
-    printf("Producer connected to semaphores successfully.\n");
 
+    printf("Producer connected to semaphores successfully.\n");
 
-    std::default_random_engine generator;
-    std::normal_distribution<double> distribution(mean, std_dev);
+    // Resolve the symbols once, ticks only carry the ids
+    if (streams_mode) {
+        for (size_t i = 0; i < streams.size(); i++) {
+            streams[i].comm_index = symbol_register(shared_buffer, streams[i].name);
+            if (streams[i].comm_index == -1) {
+                std::cerr << "Error: the symbol registry is full (" << MAX_SYMBOLS << "), " << streams[i].name << " can't be added.\n";
+                return 1;
+            }
+        }
+    } else {
+        comm_index = symbol_register(shared_buffer, commodity_name);
+        if (comm_index == -1) {
+            std::cerr << "Error: the symbol registry is full (" << MAX_SYMBOLS << "), " << commodity_name << " can't be added.\n";
+            return 1;
+        }
+    }
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        symbol_names[i] = symbol_name(&shared_buffer->symbols, i);
+    }
 
-    while (true) {
-        // Generate new price
-        double price = distribution(generator);
 
-        // Log generating a new value
-        std::cerr << get_time() << "] " << commodity_name << ": generating a new value " << price << "\n";
+    // Without --seed every run, and every producer, gets its own prices. The seed is printed to replay them.
+    if (!seeded) {
+        uint64_t mix = log_clock() ^ ((uint64_t)getpid() << 32);
+        seed = gen_splitmix64(mix);
+    }
+    printf("Generating prices with seed %llu (%s).\n", (unsigned long long)seed, gen_isa_name(isa));
 
-        // Wait on empty and mutex
-        std::cerr << get_time() << "] " << commodity_name << ": trying to get mutex on shared buffer\n";
-        semWait(sem_available_id); // Wait for the buffer to be available
-        semWait(sem_mutex_id); // Lock mutex
+    logger.start(log_level, symbol_names);
 
-        // -------------------------------------Critical Section------------------------------------------------------------------
+    if (streams_mode) {
+        // Streams are dealt round robin to the workers. SIGINT stays with this thread, which joins them once it came.
+        printf("Producing %zu streams from %d threads.\n", streams.size(), threads);
+        for (size_t i = 0; i < streams.size(); i++) {
+            requested_rate += streams[i].rate;
+        }
+        rate_start_ns = pace_clock();
+        sigset_t sigint_set;
+        sigemptyset(&sigint_set);
+        sigaddset(&sigint_set, SIGINT);
+        sigset_t waiting;
+        pthread_sigmask(SIG_BLOCK, &sigint_set, &waiting);
+        sigdelset(&waiting, SIGINT);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            std::vector<int> ids;
+            for (size_t i = t; i < streams.size(); i += threads) {
+                ids.push_back(i);
+            }
+            workers.emplace_back([&streams, ids, batch_size, seed, t, isa, poisson, cpus] {
+                pin_thread(cpus, t);
+                stream_worker(&streams, ids, batch_size, seed + t, isa, poisson);
+            });
+        }
+        // SIGINT is only let in while suspended, so it can't slip in between the check and the wait
+        while (!wait_stopping()) {
+            sigsuspend(&waiting);
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        shutdown(nullptr);
+        return 0;
+    }
 
-        printf("Producer have waited on mutex and entered critical section.\n");
+    // SLEEP_MS is kept as a rate of one batch per interval, paced against deadlines rather than slept after each batch
+    if (rate == -1) {
+        rate = sleep_interval > 0 ? batch_size * 1000.0 / sleep_interval : 0;
+    }
+    Pacer pacer(rate, burst > 0 ? burst : batch_size, poisson, seed);
+    if (rate > 0) {
+        printf("Pacing at %.0f ticks/sec%s.\n", rate, poisson ? " (Poisson arrivals)" : "");
+    }
 
-        // Write to shared memory
-        int index = shared_buffer->write_index[comm_index];
-        shared_buffer->prices[comm_index][index] = price;
-        shared_buffer->write_index[comm_index] = (index + 1) % 5;
-        push(shared_buffer, price, comm_index);
-        
-        // Log placing value
-        std::cerr << get_time() << "] " << commodity_name << ": placing " << price << " on shared buffer\n";
-        
-        //-------------------------------------End of Critical Section--------------------------------------------------------------
+    pin_thread(cpus, 0);        // The logger thread keeps the whole list
+    GaussianGenerator generator(seed, isa);
+    std::vector<double> normals(batch_size);
+    std::vector<Tick> batch(batch_size);
+    uint8_t seq = 0;
 
-        semSignal(sem_mutex_id); // Unlock mutex
-        semSignal(sem_filled_id); // Signal filled
-        printf("Producer have exited the critical section.\n");
+    while (!wait_stopping()) {
+        if (rate > 0) {
+            logger.log(LOG_INFO, EV_SLEEPING, comm_index, batch_size * 1000.0 / rate);
+        }
+        pacer.wait(batch_size);
+
+        // Generate new prices
+        generator.fill(normals.data(), batch_size);
+        for (int i = 0; i < batch_size; i++) {
+            batch[i].price = mean + std_dev * normals[i];
+            batch[i].ts_us = monotonic_us();
+            batch[i].seq = seq++;
+            batch[i].comm_index = comm_index;
+            batch[i].enqueue_lag = 0;
+
+            // Log generating a new value
+            logger.log(LOG_INFO, EV_GENERATED, comm_index, batch[i].price);
+        }
 
-        std::cerr << get_time() << "] " << commodity_name << ": sleeping for " << sleep_interval << " ms\n\n\n";
-         // Sleep
-        usleep(sleep_interval * 1000); // Convert to microseconds
+        publish_batch(batch.data(), batch_size, comm_index);
     }
 
+    shutdown(&pacer);
     return 0;
 }
@@ -0,0 +1,255 @@
+// Replay a consumer journal (--journal DIR) through the shared buffer, like a producer would, for
+// backtesting and for reproducing a recorded run offline. Ticks keep their price, commodity and
+// sequence number and are released with the gaps they were recorded with, divided by --speed
+// (--max for no pacing). Their timestamps are set when they are replayed, so the consumer's latency
+// figures describe the replay.
+//
+// Usage: ./replay DIR [--speed X | --max] [--commodity NAME] [--from S] [--to S] [--max-gap S] [--batch N]
+//                 [--shm NAME] [--hugepages] [--prefault]
+//        ./replay DIR --info       (segments, time span and ticks per commodity)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <sys/mman.h>
+
+#include "shared_buffer.h"
+#include "shm_backend.h"
+#include "journal.h"
+#include "pacer.h"
+
+ShmSegment segment;
+SharedBuffer* shared_buffer = nullptr;
+std::atomic<int>* producer_entry = nullptr;
+ProducerMetrics* metrics = nullptr;
+uint64_t replayed = 0;
+
+void handle_sigint(int sig) {
+    (void)sig;
+    printf("Replayed %llu ticks.\n", (unsigned long long)replayed);
+    producer_unregister(producer_entry);
+    shm_detach(segment);
+    exit(0);
+}
+
+// Place n ticks on the shared buffer, stamped now
+void publish(Tick ticks[], int n) {
+    uint32_t now = monotonic_us();
+    for (int i = 0; i < n; i++) {
+        ticks[i].ts_us = now;
+        ticks[i].enqueue_lag = 0;
+    }
+    publish_ticks(shared_buffer, ticks, n, metrics);
+    replayed += n;
+}
+
+void print_info(const std::string& dir, const std::vector<int>& numbers) {
+    std::map<std::string, uint64_t> totals;     // By name, ids differ between segments
+    uint64_t total = 0;
+    for (size_t s = 0; s < numbers.size(); s++) {
+        size_t bytes;
+        const JournalHeader* h = journal_map_segment(journal_segment_path(dir, numbers[s]), bytes);
+        if (!h) {
+            continue;
+        }
+        uint64_t count = h->count.load(std::memory_order_acquire);
+        time_t start = (time_t)((h->first_time_us + h->wall_offset_us) / 1000000);
+        char when[32];
+        strftime(when, sizeof(when), "%m/%d/%Y %H:%M:%S", localtime(&start));
+        printf("journal-%06d.bin  %10llu ticks  from %s  over %.3f s\n", numbers[s], (unsigned long long)count, when,
+               count > 0 ? (h->last_time_us - h->first_time_us) / 1e6 : 0.0);
+        for (int c = 0; c < MAX_SYMBOLS; c++) {
+            if (h->ticks[c] > 0) {
+                totals[h->names[c]] += h->ticks[c];
+            }
+        }
+        total += count;
+        munmap(const_cast<JournalHeader*>(h), bytes);
+    }
+    printf("%llu ticks in %zu segments\n", (unsigned long long)total, numbers.size());
+    for (std::map<std::string, uint64_t>::const_iterator it = totals.begin(); it != totals.end(); ++it) {
+        printf("  %-12s %10llu\n", it->first.c_str(), (unsigned long long)it->second);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Error not enough arguments passed.\n"
+                     "Usage: ./replay DIR [--speed X | --max] [--commodity NAME] [--from S] [--to S] [--max-gap S] [--batch N]\n"
+                     "                [--shm NAME] [--hugepages] [--prefault]\n"
+                     "       ./replay DIR --info\n";
+        return 1;
+    }
+    std::string dir = argv[1];
+    double speed = 1;           // 0 for as fast as the buffer takes them
+    std::string commodity;      // Only this symbol, all when empty
+    double from = 0;            // Seconds from the start of the journal
+    double to = -1;
+    double max_gap = 5;         // Longer pauses (between consumer runs, say) are cut to this
+    int batch_size = 64;
+    bool info = false;
+    ShmOptions shm_options;
+    for (int i = 2; i < argc; ) {
+        int used = shm_parse_option(shm_options, argc, argv, i);
+        if (used > 0) {
+            i += used;
+            continue;
+        }
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--speed") == 0 && has_value) {
+            speed = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--max") == 0) {
+            speed = 0;
+        } else if (strcmp(argv[i], "--commodity") == 0 && has_value) {
+            commodity = argv[++i];
+            char normalized[SYMBOL_NAME_SIZE];
+            if (!symbol_normalize(commodity, normalized)) {
+                std::cerr << "Error Invalid commodity name " << commodity << ".\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--from") == 0 && has_value) {
+            from = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--to") == 0 && has_value) {
+            to = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--max-gap") == 0 && has_value) {
+            max_gap = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && has_value) {
+            batch_size = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--info") == 0) {
+            info = true;
+        } else {
+            std::cerr << "Error unknown option " << argv[i] << ".\n";
+            return 1;
+        }
+        i++;
+    }
+    if (speed < 0 || from < 0 || max_gap < 0 || batch_size < 1 || batch_size > MAX_BATCH) {
+        std::cerr << "Error Invalid option value: speed, --from and --max-gap must be 0 or more, --batch between 1 and " << MAX_BATCH << ".\n";
+        return 1;
+    }
+
+    std::vector<int> numbers = journal_list_segments(dir);
+    if (numbers.empty()) {
+        std::cerr << "Error: no journal segments in " << dir << ".\n";
+        return 1;
+    }
+    if (info) {
+        print_info(dir, numbers);
+        return 0;
+    }
+
+    signal(SIGINT, handle_sigint);
+    if (!shm_attach(shm_options, segment)) {
+        return 1;
+    }
+    shared_buffer = (SharedBuffer*)segment.addr;
+    const char* layout_error = header_check(shared_buffer, segment.size);
+    if (layout_error) {
+        std::cerr << "Error: " << layout_error << ".\n";
+        return 1;
+    }
+    producer_entry = producer_register(shared_buffer);
+    metrics = producer_metrics(shared_buffer, producer_entry);
+    batch_size = std::min(batch_size, shared_buffer->header.buffer_size);
+    wait_set_strategy(WAIT_ADAPTIVE);
+
+    std::vector<Tick> batch;
+    batch.reserve(batch_size);
+    uint64_t journal_start_us = 0;
+    uint64_t from_us = 0, to_us = UINT64_MAX;
+    bool started = false;
+    double virtual_us = 0;          // Recorded time replayed so far, with long gaps cut
+    uint64_t previous_us = 0;
+    uint64_t start_ns = pace_clock();
+
+    for (size_t s = 0; s < numbers.size(); s++) {
+        size_t bytes;
+        const JournalHeader* h = journal_map_segment(journal_segment_path(dir, numbers[s]), bytes);
+        if (!h) {
+            return 1;
+        }
+        uint64_t count = h->count.load(std::memory_order_acquire);
+        if (s == 0) {
+            journal_start_us = h->first_time_us;
+            from_us = journal_start_us + (uint64_t)(from * 1e6);
+            if (to >= 0) {
+                to_us = journal_start_us + (uint64_t)(to * 1e6);
+            }
+        }
+        if (count == 0 || h->last_time_us < from_us) {
+            munmap(const_cast<JournalHeader*>(h), bytes);
+            continue;
+        }
+        if (h->first_time_us > to_us) {
+            munmap(const_cast<JournalHeader*>(h), bytes);
+            break;
+        }
+        // Ids are the segment's own: the symbol wanted has one per segment, and every name is
+        // registered with the live segment the first time it comes up
+        int comm = commodity.empty() ? -1 : journal_find_symbol(h, commodity);
+        if (!commodity.empty() && comm == -1) {
+            munmap(const_cast<JournalHeader*>(h), bytes);
+            continue;
+        }
+        std::vector<int> live_ids(MAX_SYMBOLS, -1);
+        uint64_t time_us;
+        uint64_t record = journal_seek(h, from_us, time_us);
+        const Tick* records = journal_records(h);
+        for (; record < count; record++) {
+            Tick tick = records[record];
+            time_us = journal_unwrap(time_us, tick.ts_us);
+            if ((comm != -1 && tick.comm_index != comm) || tick.comm_index >= MAX_SYMBOLS || time_us < from_us) {
+                continue;
+            }
+            if (time_us > to_us) {
+                break;
+            }
+            if (started) {
+                double gap = time_us > previous_us ? (double)(time_us - previous_us) : 0;
+                virtual_us += std::min(gap, max_gap * 1e6);
+            }
+            started = true;
+            previous_us = time_us;
+            int& live_id = live_ids[tick.comm_index];
+            if (live_id == -1) {
+                live_id = symbol_register(shared_buffer, h->names[tick.comm_index]);
+                if (live_id == -1) {
+                    std::cerr << "Error: can't register symbol " << h->names[tick.comm_index] << " (registry full?).\n";
+                    return 1;
+                }
+            }
+            tick.comm_index = (uint16_t)live_id;
+
+            if (speed > 0) {
+                uint64_t due = start_ns + (uint64_t)(virtual_us * 1000 / speed);
+                if (!batch.empty() && due > pace_clock()) {
+                    publish(batch.data(), (int)batch.size());       // Everything already due goes first
+                    batch.clear();
+                }
+                pace_sleep_until(due);
+            }
+            batch.push_back(tick);
+            if ((int)batch.size() == batch_size) {
+                publish(batch.data(), (int)batch.size());
+                batch.clear();
+            }
+        }
+        munmap(const_cast<JournalHeader*>(h), bytes);
+    }
+    if (!batch.empty()) {
+        publish(batch.data(), (int)batch.size());
+    }
+
+    double elapsed = (pace_clock() - start_ns) / 1e9;
+    printf("Replayed %llu ticks (%.3f s of recording) in %.3f s.\n", (unsigned long long)replayed, virtual_us / 1e6, elapsed);
+    producer_unregister(producer_entry);
+    shm_detach(segment);
+    return 0;
+}
@@ -0,0 +1,266 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+// Fixed-capacity ring for queues inside one process, header-only: RingBuffer<T, Capacity, Sync>.
+// The capacity is a compile-time power of two, so indexes wrap with a constexpr mask, and the
+// synchronization is a policy given as the third parameter:
+//   LockFreeSync   TickRing's slot/sequence core (seq_ring_try_push/pop in shared_buffer.h): producers
+//                  claim slots with one CAS on tail and each slot's sequence number publishes it;
+//                  waiters sleep on futex WaitWords only when full/empty
+//   SpinSync       a test-and-test-and-set lock around each batch
+//   SemaphoreSync  the semaphore transport's scheme: a mutex around each batch, sleeping for room or
+//                  items, with condition variables standing in for the filled/available semaphores
+// LockFreeSync and SpinSync wait for room or items like the rings of the transports: polling per
+// wait_strategy, then sleeping on a futex WaitWord.
+// Any number of producers, one consumer. The shared-memory transports don't use it: they keep their runtime
+// size and transport (consumer arguments), and only share the lock-free slot core. It is for the consumer's
+// drain -> compute pipeline and the like, whose policy is a build option (PIPELINE_SYNC, Makefile variants).
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "shared_buffer.h"
+
+struct LockFreeSync {
+    static const char* name() { return "lockfree"; }
+};
+
+struct SpinSync {
+    static const char* name() { return "spin"; }
+};
+
+struct SemaphoreSync {
+    static const char* name() { return "sem"; }
+};
+
+// What every policy shares: the capacity check and the index mask
+template <size_t Capacity>
+struct RingGeometry {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Ring capacity must be a power of two");
+    static constexpr size_t capacity = Capacity;
+    static constexpr uint64_t mask = Capacity - 1;
+};
+
+// Interface of every specialization (n must not exceed Capacity):
+//   bool try_push_batch(const T items[], int n)    all n or nothing, false if there isn't room
+//   bool push_batch(const T items[], int n)        waits for room, false if the process is stopping
+//   int try_pop_batch(T items[], int max)          up to max, 0 if empty (consumer only)
+//   int pop_batch(T items[], int max)              waits for at least one, 0 if stopping (consumer only)
+template <typename T, size_t Capacity, typename Sync>
+class RingBuffer;
+
+// ---------------------------------------- Lock-free ----------------------------------------
+
+template <typename T, size_t Capacity>
+class RingBuffer<T, Capacity, LockFreeSync> : public RingGeometry<Capacity> {
+public:
+    using RingGeometry<Capacity>::mask;
+
+    RingBuffer() : tail_(0), head_(0) {
+        for (size_t i = 0; i < Capacity; i++) {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        not_full_.seq.store(0);
+        not_full_.waiters.store(0);
+        not_empty_.seq.store(0);
+        not_empty_.waiters.store(0);
+    }
+
+    bool try_push_batch(const T items[], int n) {
+        return seq_ring_try_push(tail_, slots_, mask, items, n);
+    }
+
+    bool push_batch(const T items[], int n) {
+        if (!wait_until(not_full_, [&] { return try_push_batch(items, n); })) {
+            return false;
+        }
+        wake_waiters(not_empty_);
+        return true;
+    }
+
+    int try_pop_batch(T items[], int max) {
+        return seq_ring_try_pop(head_, slots_, mask, items, max);
+    }
+
+    int pop_batch(T items[], int max) {
+        int n = 0;
+        wait_until(not_empty_, [&] { return (n = try_pop_batch(items, max)) > 0; });
+        wake_waiters(not_full_);
+        return n;
+    }
+
+private:
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail_;   // Next position claimed by producers
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head_;   // Next position read by the consumer
+    WaitWord not_full_;
+    WaitWord not_empty_;
+    SeqSlot<T> slots_[Capacity];
+};
+
+// ---------------------------------------- Spin lock ----------------------------------------
+
+template <typename T, size_t Capacity>
+class RingBuffer<T, Capacity, SpinSync> : public RingGeometry<Capacity> {
+public:
+    using RingGeometry<Capacity>::mask;
+
+    RingBuffer() : locked_(false), tail_(0), published_(0), head_(0) {
+        not_full_.seq.store(0);
+        not_full_.waiters.store(0);
+        not_empty_.seq.store(0);
+        not_empty_.waiters.store(0);
+    }
+
+    bool try_push_batch(const T items[], int n) {
+        lock();
+        bool room = tail_ + n - head_.load(std::memory_order_acquire) <= Capacity;
+        if (room) {
+            for (int i = 0; i < n; i++) {
+                items_[(tail_ + i) & mask] = items[i];
+            }
+            published_.store(tail_ + n, std::memory_order_release);
+            tail_ += n;
+        }
+        unlock();
+        return room;
+    }
+
+    bool push_batch(const T items[], int n) {
+        if (!wait_until(not_full_, [&] { return try_push_batch(items, n); })) {
+            return false;
+        }
+        wake_waiters(not_empty_);
+        return true;
+    }
+
+    int try_pop_batch(T items[], int max) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t ready = published_.load(std::memory_order_acquire) - head;
+        int n = ready < (uint64_t)max ? (int)ready : max;
+        for (int i = 0; i < n; i++) {
+            items[i] = items_[(head + i) & mask];
+        }
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    int pop_batch(T items[], int max) {
+        int n = 0;
+        wait_until(not_empty_, [&] { return (n = try_pop_batch(items, max)) > 0; });
+        wake_waiters(not_full_);
+        return n;
+    }
+
+private:
+    void lock() {
+        while (locked_.load(std::memory_order_relaxed) || locked_.exchange(true, std::memory_order_acquire)) {
+            _mm_pause();
+        }
+    }
+
+    void unlock() {
+        locked_.store(false, std::memory_order_release);
+    }
+
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> locked_;
+    uint64_t tail_;                                             // Producers, under the lock
+    std::atomic<uint64_t> published_;                           // Tail the consumer may read up to
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head_;       // Consumer
+    WaitWord not_full_;
+    WaitWord not_empty_;
+    T items_[Capacity];
+};
+
+// ---------------------------------------- Semaphore ----------------------------------------
+
+template <typename T, size_t Capacity>
+class RingBuffer<T, Capacity, SemaphoreSync> : public RingGeometry<Capacity> {
+public:
+    using RingGeometry<Capacity>::mask;
+
+    RingBuffer() : tail_(0), head_(0) {}
+
+    bool try_push_batch(const T items[], int n) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (tail_ + n - head_ > Capacity) {
+            return false;
+        }
+        push_locked(items, n);
+        return true;
+    }
+
+    bool push_batch(const T items[], int n) {
+        std::unique_lock<std::mutex> guard(mutex_);
+        if (tail_ + n - head_ > Capacity) {
+            WaitTimer timer;
+            if (!wait(available_, guard, [&] { return tail_ + n - head_ <= Capacity; })) {
+                return false;
+            }
+        }
+        push_locked(items, n);
+        return true;
+    }
+
+    int try_pop_batch(T items[], int max) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return pop_locked(items, max);
+    }
+
+    int pop_batch(T items[], int max) {
+        std::unique_lock<std::mutex> guard(mutex_);
+        if (tail_ == head_) {
+            WaitTimer timer;
+            if (!wait(filled_, guard, [&] { return tail_ != head_; })) {
+                return 0;
+            }
+        }
+        return pop_locked(items, max);
+    }
+
+private:
+    // Wait on cv until ready(), waking every WAIT_STOP_POLL_NS to give up if the process is stopping
+    template <typename Ready>
+    static bool wait(std::condition_variable& cv, std::unique_lock<std::mutex>& guard, Ready ready) {
+        while (!cv.wait_for(guard, std::chrono::nanoseconds(WAIT_STOP_POLL_NS), ready)) {
+            if (wait_stopping()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void push_locked(const T items[], int n) {
+        for (int i = 0; i < n; i++) {
+            items_[(tail_ + i) & mask] = items[i];
+        }
+        tail_ += n;
+        filled_.notify_one();
+    }
+
+    int pop_locked(T items[], int max) {
+        uint64_t ready = tail_ - head_;
+        int n = ready < (uint64_t)max ? (int)ready : max;
+        for (int i = 0; i < n; i++) {
+            items[i] = items_[(head_ + i) & mask];
+        }
+        head_ += n;
+        if (n > 0) {
+            available_.notify_all();    // Producers may be waiting for different amounts of room
+        }
+        return n;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable filled_;
+    std::condition_variable available_;
+    uint64_t tail_;
+    uint64_t head_;
+    T items_[Capacity];
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef ROLLING_STATS_H
+#define ROLLING_STATS_H
+
+// Rolling statistics over the last `window` prices of one commodity.
+// Every add() is O(1): sums and the Welford mean/M2 are updated incrementally as prices enter and
+// leave the window, and min/max come from monotonic deques.
+
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <utility>
+#include <stdint.h>
+
+#define DEFAULT_WINDOW 5
+#define MIN_WINDOW 5
+#define MAX_WINDOW 100000
+
+class RollingStats {
+public:
+    explicit RollingStats(int window = DEFAULT_WINDOW)
+        : window_(window), prices_(window), weights_(window), next_(0), count_(0), added_(0),
+          mean_(0), m2_(0), ewma_(0), alpha_(2.0 / (window + 1)), weighted_sum_(0), weight_total_(0),
+          last_price_(0), last_ts_us_(0) {}
+
+    // Add a price stamped with the producer's CLOCK_MONOTONIC microseconds
+    void add(double price, uint32_t ts_us) {
+        // The previous price was in force until now: that is its weight for the time-weighted average
+        if (count_ > 0) {
+            double held = (double)(uint32_t)(ts_us - last_ts_us_);
+            int newest = (next_ + window_ - 1) % window_;
+            weights_[newest] = held;
+            weighted_sum_ += last_price_ * held;
+            weight_total_ += held;
+        }
+
+        if (count_ == window_) {
+            // Slide: replace the oldest price (at next_) with the new one
+            double old = prices_[next_];
+            double old_mean = mean_;
+            mean_ += (price - old) / window_;
+            m2_ += (price - old) * (price - mean_ + old - old_mean);
+            weighted_sum_ -= old * weights_[next_];
+            weight_total_ -= weights_[next_];
+        } else {
+            count_++;
+            double delta = price - mean_;
+            mean_ += delta / count_;
+            m2_ += delta * (price - mean_);
+        }
+        if (m2_ < 0) {
+            m2_ = 0;    // rounding can push it slightly negative
+        }
+
+        ewma_ = added_ == 0 ? price : ewma_ + alpha_ * (price - ewma_);
+
+        // Drop expired entries from the front, dominated ones from the back
+        while (!min_q_.empty() && min_q_.front().first + window_ <= added_) {
+            min_q_.pop_front();
+        }
+        while (!max_q_.empty() && max_q_.front().first + window_ <= added_) {
+            max_q_.pop_front();
+        }
+        while (!min_q_.empty() && min_q_.back().second >= price) {
+            min_q_.pop_back();
+        }
+        while (!max_q_.empty() && max_q_.back().second <= price) {
+            max_q_.pop_back();
+        }
+        min_q_.push_back(std::make_pair(added_, price));
+        max_q_.push_back(std::make_pair(added_, price));
+
+        prices_[next_] = price;
+        weights_[next_] = 0;
+        next_ = (next_ + 1) % window_;
+        added_++;
+        last_price_ = price;
+        last_ts_us_ = ts_us;
+    }
+
+    int window() const { return window_; }
+    int count() const { return count_; }
+    double last() const { return last_price_; }
+    double mean() const { return mean_; }
+    double ewma() const { return ewma_; }
+    double variance() const { return count_ > 0 ? m2_ / count_ : 0; }
+    double stddev() const { return std::sqrt(variance()); }
+    double min() const { return min_q_.empty() ? 0 : min_q_.front().second; }
+    double max() const { return max_q_.empty() ? 0 : max_q_.front().second; }
+
+    // Time-weighted average price: each price weighted by how long it stayed the latest one.
+    // Ticks carry no volume, so this takes the place of a VWAP. Falls back to the mean until time has passed.
+    double twap() const { return weight_total_ > 0 ? weighted_sum_ / weight_total_ : mean_; }
+
+private:
+    int window_;
+    std::vector<double> prices_;        // Circular window of prices
+    std::vector<double> weights_;       // How long each price was the latest one (0 for the newest)
+    int next_;                          // Slot the next price goes to (the oldest once the window is full)
+    int count_;                         // Prices currently in the window
+    uint64_t added_;                    // Prices added since the start
+    double mean_;
+    double m2_;                         // Sum of squared deviations from the mean (Welford)
+    double ewma_;
+    double alpha_;
+    double weighted_sum_;
+    double weight_total_;
+    double last_price_;
+    uint32_t last_ts_us_;
+    std::deque<std::pair<uint64_t, double> > min_q_;   // (index, price), increasing prices
+    std::deque<std::pair<uint64_t, double> > max_q_;   // (index, price), decreasing prices
+};
+
+#endif
@@ -0,0 +1,980 @@
+#ifndef SHARED_BUFFER_H
+#define SHARED_BUFFER_H
+
+// Shared memory layout used by both the producer and the consumer.
+// Both binaries must be built from this header so the layout always matches.
+
+#include <iostream>
+#include <atomic>
+#include <climits>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/sem.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <cerrno>
+#include <csignal>
+
+#include "wait_strategy.h"
+#include "symbol_table.h"
+#include "rolling_stats.h"
+
+#define SHARD_COUNT 16                  // Rings of the sharded transport, symbols are spread over them by id
+#define MAX_BUFFER_SIZE (1 << 24)       // Most slots a ring can have (rounded up to a power of two)
+#define MAX_SEM_BUFFER_SIZE (1 << 14)   // Semaphore transport limit, semaphore values can't exceed SEMVMX (32767)
+#define MAX_BATCH 4096                  // Most ticks the consumer drains in one pass
+#define MAX_READERS 8                   // Consumers that can attach to a broadcast ring
+#define MAX_PRODUCERS 64                // Producer processes tracked in the segment (more still work, untracked)
+#define CACHE_LINE_SIZE 64
+
+// Transport used to move prices from the producers to the consumer (chosen by the consumer).
+enum Transport {
+    TRANSPORT_SEMAPHORE = 0,    // queue guarded by the mutex/filled/available semaphores
+    TRANSPORT_LOCKFREE = 1,     // lock-free MPSC ring, futex sleep only when full or empty
+    TRANSPORT_SHARDED = 2,      // SHARD_COUNT lock-free rings split by symbol, consumer polls across them
+    TRANSPORT_BROADCAST = 3     // ring written once, every attached consumer reads it with its own cursor
+};
+
+// Futex word used to sleep on a condition; waiters are only woken when someone is sleeping.
+struct alignas(CACHE_LINE_SIZE) WaitWord {
+    std::atomic<uint32_t> seq;      // bumped on every wake so sleepers can't miss it
+    std::atomic<uint32_t> waiters;  // number of processes sleeping (or about to sleep) on seq
+};
+
+// One price update as it travels through the buffer. Fixed 16 bytes, self-describing.
+struct Tick {
+    double price;           // Price exactly as generated (no truncation)
+    uint32_t ts_us;         // Producer CLOCK_MONOTONIC timestamp in microseconds (wraps every ~71 minutes)
+    uint16_t comm_index;    // Symbol id in SharedBuffer::symbols
+    uint8_t seq;            // Per-producer sequence number (wraps)
+    uint8_t enqueue_lag;    // Time from ts_us until the producer enqueued it, see lag_encode
+};
+static_assert(sizeof(Tick) == 16, "Tick must stay 16 bytes");
+
+// Microseconds packed into a byte, log-linear: exact below 8, then 3 bits of mantissa per power of two
+// (at most 12.5% low), saturating around 2^34 us.
+inline uint8_t lag_encode(uint32_t us) {
+    if (us < 8) {
+        return (uint8_t)us;
+    }
+    int top = 31 - __builtin_clz(us);       // >= 3
+    int exp = top - 2;                      // 1..29
+    return (uint8_t)((exp << 3) | ((us >> (top - 3)) & 7));
+}
+
+inline uint32_t lag_decode(uint8_t code) {
+    int exp = code >> 3;
+    if (exp == 0) {
+        return code;
+    }
+    return (uint32_t)(8 | (code & 7)) << (exp - 1);
+}
+
+// Microsecond CLOCK_MONOTONIC timestamp for Tick::ts_us
+inline uint32_t monotonic_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+// A ring slot. seq == pos means free for position pos, seq == pos + 1 means filled for pos.
+template <typename T>
+struct SeqSlot {
+    std::atomic<uint64_t> seq;
+    T item;
+};
+typedef SeqSlot<Tick> RingSlot;
+
+// Bounded lock-free ring: many producers, one consumer.
+// Read-only, producer-written and consumer-written fields each sit on their own cache line.
+// The slots live in the variable part of the segment, found through an offset from the ring itself
+// so every process can use them wherever the segment is attached.
+struct alignas(CACHE_LINE_SIZE) TickRing {
+    uint64_t capacity;                                     // power of two, set once by the consumer
+    uint64_t mask;                                         // capacity - 1
+    int64_t slots_offset;                                  // byte offset of the slots from this ring
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail;   // next position claimed by producers
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;   // next position read by the consumer
+    WaitWord not_full;              // producers sleep here when the ring is full
+    WaitWord not_empty;             // the consumer sleeps here when the ring is empty
+};
+
+inline RingSlot* ring_slots(TickRing* r) {
+    return reinterpret_cast<RingSlot*>(reinterpret_cast<char*>(r) + r->slots_offset);
+}
+
+#define SHARED_BUFFER_MAGIC 0x4C414235u     // "LAB5"
+#define SHARED_BUFFER_VERSION 12            // Bump on any change to the shared memory layout
+
+// First cache line of the segment. Written once by the consumer, read-only afterwards.
+// Producers learn the capacity and where the queue lives from here.
+struct alignas(CACHE_LINE_SIZE) SharedHeader {
+    std::atomic<uint32_t> magic;    // SHARED_BUFFER_MAGIC, stored last once everything else is initialized
+    uint32_t version;               // SHARED_BUFFER_VERSION of the consumer that created the segment
+    uint64_t size;                  // Total segment size in bytes
+    uint64_t fixed_size;            // sizeof(SharedBuffer) in the consumer that created the segment
+    uint64_t queue_offset;          // Byte offset of the semaphore transport's Tick array
+    int buffer_size;                // Buffer size (power of two)
+    int mask;                       // buffer_size - 1, indexes wrap with & instead of %
+    int transport;                  // One of Transport, set by the consumer
+    int sem_mutex_id;               // SysV semaphore ids created by the consumer (IPC_PRIVATE, so no key clashes)
+    int sem_filled_id;
+    int sem_available_id;
+    int owner_pid;                  // Consumer that owns the segment: its creator, or one that reattached after it died
+};
+
+enum ReaderState {
+    READER_FREE = 0,        // Cursor not in use
+    READER_GATING = 1,      // Producers never overwrite a tick this reader hasn't read
+    READER_LOSSY = 2        // Reader skips ahead when producers lap it, never slows them down
+};
+
+// Read cursor of one consumer attached to the broadcast ring, on its own cache line.
+struct alignas(CACHE_LINE_SIZE) ReaderCursor {
+    std::atomic<uint64_t> position;     // Next ring position this reader will read
+    std::atomic<uint32_t> state;        // One of ReaderState
+    int pid;                            // Owner, for diagnostics
+};
+
+// Latest state of one commodity in the last-value cache, see lvc_update
+struct alignas(CACHE_LINE_SIZE) LastValue {
+    std::atomic<uint32_t> version;  // Seqlock: odd while a producer writes the entry
+    uint32_t ts_us;                 // Producer timestamp of price
+    uint64_t updates;               // Prices published for the commodity so far
+    double price;
+    double mean;                    // Of every price published
+    double ewma;                    // Smoothed like the dashboard's default window
+    double min;
+    double max;
+};
+static_assert(sizeof(LastValue) == CACHE_LINE_SIZE, "A last-value entry must fill exactly one cache line");
+
+// Counters of one producer process (same index as its SharedBuffer::producers entry), read by ./stats.
+// A new producer in the entry carries on from its predecessor's counts, so they only ever grow.
+struct alignas(CACHE_LINE_SIZE) ProducerMetrics {
+    std::atomic<uint64_t> ticks;        // Published
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> blocked;      // Batches that had to wait for room in the buffer (or for the mutex)
+    std::atomic<uint64_t> blocked_ns;   // How long they waited: the back-pressure the consumer puts on producers
+};
+
+// Counters of the consumer that owns the segment, written by its drain thread only
+struct alignas(CACHE_LINE_SIZE) ConsumerMetrics {
+    std::atomic<uint64_t> ticks;        // Drained
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> idle_ns;      // Time spent waiting for ticks
+    std::atomic<uint64_t> skipped;      // Lapped by producers (lossy broadcast reader)
+};
+
+struct Metrics {
+    ConsumerMetrics consumer;
+    ProducerMetrics producers[MAX_PRODUCERS];
+    std::atomic<uint64_t> symbol_ticks[MAX_SYMBOLS];   // Drained per symbol id, by the consumer
+};
+
+// Structure for shared memory. Followed in the same segment by the slots of the chosen transport,
+// sized at runtime (see shared_buffer_size).
+struct SharedBuffer {
+    SharedHeader header;
+    alignas(CACHE_LINE_SIZE) int rear;      // Rear of the queue (written by producers)
+    alignas(CACHE_LINE_SIZE) int front;     // Front of the queue (written by the consumer)
+    alignas(CACHE_LINE_SIZE) int count;     // Number of elements in the buffer (written by both)
+    TickRing ring;                      // Used instead of the queue when transport is TRANSPORT_LOCKFREE
+    TickRing shards[SHARD_COUNT];       // Rings of TRANSPORT_SHARDED, symbol id % SHARD_COUNT
+    WaitWord shard_doorbell;            // The consumer sleeps here when every shard is empty
+    alignas(CACHE_LINE_SIZE) int next_shard;    // Shard the consumer polls first next time (round robin)
+    ReaderCursor readers[MAX_READERS];  // Consumers of the ring when transport is TRANSPORT_BROADCAST
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> reader_gate;   // Slowest gating reader when producers last looked, see broadcast_try_claim
+    std::atomic<int> producers[MAX_PRODUCERS];  // Pids of the attached producers, 0 for a free entry
+    LastValue last_values[MAX_SYMBOLS];         // Last-value cache by symbol id, written by producers whatever the transport
+    SymbolTable symbols;                        // Names of the symbol ids ticks carry
+    Metrics metrics;                            // Counters for monitoring, see metric_add
+};
+
+// Queued ticks of the semaphore transport
+inline Tick* buffer_ticks(SharedBuffer* sb) {
+    return reinterpret_cast<Tick*>(reinterpret_cast<char*>(sb) + sb->header.queue_offset);
+}
+
+// Round up to the next power of two so indexes can wrap with a mask
+inline int round_up_pow2(int n) {
+    int p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+// Bytes needed for a segment using transport with buffer_size (a power of two) slots
+inline size_t shared_buffer_size(int transport, int buffer_size) {
+    size_t size = sizeof(SharedBuffer);
+    if (transport == TRANSPORT_SEMAPHORE) {
+        size += (size_t)buffer_size * sizeof(Tick);
+    } else if (transport == TRANSPORT_LOCKFREE || transport == TRANSPORT_BROADCAST) {
+        size += (size_t)buffer_size * sizeof(RingSlot);
+    } else {
+        size += (size_t)SHARD_COUNT * buffer_size * sizeof(RingSlot);
+    }
+    return size;
+}
+
+// Fill in the header (consumer only). Producers can't attach until header_publish.
+inline void header_init(SharedBuffer* sb, int buffer_size, int transport) {
+    sb->header.version = SHARED_BUFFER_VERSION;
+    sb->header.size = shared_buffer_size(transport, buffer_size);
+    sb->header.fixed_size = sizeof(SharedBuffer);
+    sb->header.queue_offset = sizeof(SharedBuffer);
+    sb->header.buffer_size = buffer_size;
+    sb->header.mask = buffer_size - 1;
+    sb->header.transport = transport;
+    sb->header.owner_pid = getpid();
+}
+
+// Publish the header once the rest of the segment is initialized (consumer only)
+inline void header_publish(SharedBuffer* sb) {
+    sb->header.magic.store(SHARED_BUFFER_MAGIC, std::memory_order_release);
+}
+
+// Check that an attached segment was created by a compatible binary. Returns an error message or nullptr.
+inline const char* header_check(const SharedBuffer* sb, size_t segment_size) {
+    if (segment_size < sizeof(SharedHeader) || sb->header.magic.load(std::memory_order_acquire) != SHARED_BUFFER_MAGIC) {
+        return "shared memory is not initialized or was not created by the consumer";
+    }
+    if (sb->header.version != SHARED_BUFFER_VERSION) {
+        return "shared memory layout version differs from this binary, rebuild both producer and consumer";
+    }
+    if (sb->header.fixed_size != sizeof(SharedBuffer) || segment_size < sb->header.size) {
+        return "shared memory size differs from this binary, rebuild both producer and consumer";
+    }
+    return nullptr;
+}
+
+// Push values into the buffer
+inline void push(SharedBuffer* sb, const Tick& tick) {
+    if (sb->count < sb->header.buffer_size) {
+        buffer_ticks(sb)[sb->rear] = tick;
+        sb->rear = (sb->rear + 1) & sb->header.mask;  // Wrap around
+        sb->count++;
+    } else {
+        std::cerr << "Buffer is full! Cannot push.\n";
+    }
+}
+
+// Push several ticks with one pass over the queue indexes (caller holds the mutex)
+inline void push_batch(SharedBuffer* sb, const Tick ticks[], int n) {
+    for (int i = 0; i < n; i++) {
+        push(sb, ticks[i]);
+    }
+}
+
+// Semaphore operations
+// Decrease the semaphore value by n (blocks until n units are available, polling first per wait_strategy).
+// Returns false, without taking anything, if the process is stopping (wait_request_stop).
+inline bool semWait(int semid, int n = 1, short flags = 0) {
+    struct sembuf sop = {0, (short)-n, (short)(flags | IPC_NOWAIT)};
+    int result = semop(semid, &sop, 1);
+    if (result == -1 && errno == EAGAIN) {
+        WaitTimer timer;
+        bool done = wait_spin((uintptr_t)semid, [&] {
+            result = semop(semid, &sop, 1);
+            return result == 0 || errno != EAGAIN;
+        });
+        // Sleep in slices, so a stop request is seen even if the units never come
+        const struct timespec slice = {0, WAIT_STOP_POLL_NS};
+        sop.sem_flg = flags;
+        while (!done) {
+            if (wait_stopping()) {
+                return false;
+            }
+            result = semtimedop(semid, &sop, 1, &slice);
+            done = result == 0 || (errno != EAGAIN && errno != EINTR);
+        }
+    }
+    if (result == -1) {
+        perror("semWait failed");
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+// Increase the semaphore value by n
+inline void semSignal(int semid, int n = 1, short flags = 0) {
+    struct sembuf sop = {0, (short)n, flags};
+    if (semop(semid, &sop, 1) == -1) {
+        perror("semSignal failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// The mutex semaphore is taken with SEM_UNDO: if its holder dies inside the critical section the kernel
+// gives it back, instead of every other process waiting on it forever.
+inline bool semLock(int semid) {
+    return semWait(semid, 1, SEM_UNDO);
+}
+
+inline void semUnlock(int semid) {
+    semSignal(semid, 1, SEM_UNDO);
+}
+
+// ---------------------------------------- Symbols ----------------------------------------
+
+// Id of name in the segment's registry, registering it if it is new (under the mutex semaphore, so
+// concurrent producers agree on ids). Returns -1 if the name is invalid, the registry is full or the
+// process is stopping.
+inline int symbol_register(SharedBuffer* sb, const std::string& name) {
+    char normalized[SYMBOL_NAME_SIZE];
+    if (!symbol_normalize(name, normalized)) {
+        return -1;
+    }
+    uint32_t slot;
+    int id = symbol_find(&sb->symbols, normalized, slot);
+    if (id == -1 && semLock(sb->header.sem_mutex_id)) {
+        id = symbol_insert(&sb->symbols, normalized);
+        semUnlock(sb->header.sem_mutex_id);
+    }
+    return id;
+}
+
+// ---------------------------------------- Process tracking ----------------------------------------
+
+inline bool pid_alive(int pid) {
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+// Record this producer in the segment, reusing the entry of one that died. Returns nullptr if all are taken.
+inline std::atomic<int>* producer_register(SharedBuffer* sb) {
+    int self = getpid();
+    for (int i = 0; i < MAX_PRODUCERS; i++) {
+        std::atomic<int>& entry = sb->producers[i];
+        int pid = entry.load();
+        if ((pid == 0 || !pid_alive(pid)) && entry.compare_exchange_strong(pid, self)) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+inline void producer_unregister(std::atomic<int>* entry) {
+    if (entry) {
+        entry->store(0);
+    }
+}
+
+// ---------------------------------------- Metrics ----------------------------------------
+// Counters are updated once per batch (per tick only for the consumer's symbol counts) with relaxed
+// atomics and never read back by the hot path; waits are only timed when they don't succeed at once
+// (wait_thread_ns), so the counters can stay on.
+
+// Add to a counter other threads or processes may add to as well
+inline void metric_add(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+// Add to a counter only the calling thread writes: a plain load and store, no locked instruction
+inline void metric_add_owned(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Counters of a registered producer, or a private scratch block when it got no entry
+inline ProducerMetrics* producer_metrics(SharedBuffer* sb, std::atomic<int>* entry) {
+    static ProducerMetrics untracked;
+    return entry ? &sb->metrics.producers[entry - sb->producers] : &untracked;
+}
+
+// Count a published batch. waited_ns is wait_thread_ns() diffed around the publish.
+inline void metrics_published(ProducerMetrics* m, int n, uint64_t waited_ns) {
+    metric_add(m->ticks, n);
+    metric_add(m->batches, 1);
+    if (waited_ns > 0) {
+        metric_add(m->blocked, 1);
+        metric_add(m->blocked_ns, waited_ns);
+    }
+}
+
+// Producers and broadcast readers other than except_pid that are still running
+inline int live_users(const SharedBuffer* sb, int except_pid) {
+    int users = 0;
+    for (int i = 0; i < MAX_PRODUCERS; i++) {
+        int pid = sb->producers[i].load();
+        if (pid != except_pid && pid_alive(pid)) {
+            users++;
+        }
+    }
+    for (int i = 0; i < MAX_READERS; i++) {
+        if (sb->readers[i].state.load() != READER_FREE && sb->readers[i].pid != except_pid && pid_alive(sb->readers[i].pid)) {
+            users++;
+        }
+    }
+    return users;
+}
+
+// ---------------------------------------- Lock-free ring ----------------------------------------
+
+// Sleep while *word == expected, at most WAIT_STOP_POLL_NS
+inline void futex_wait(std::atomic<uint32_t>* word, uint32_t expected) {
+    const struct timespec slice = {0, WAIT_STOP_POLL_NS};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &slice, nullptr, 0);
+}
+
+inline void futex_wake_all(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Wake everyone sleeping on w. Costs a single load when nobody is waiting.
+inline void wake_waiters(WaitWord& w) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (w.waiters.load(std::memory_order_relaxed) != 0) {
+        w.seq.fetch_add(1);
+        futex_wake_all(&w.seq);
+    }
+}
+
+// Sleep on w until try_op() succeeds, polling first per wait_strategy.
+// Returns false, with try_op() never having succeeded, if the process is stopping (wait_request_stop).
+template <typename Op>
+inline bool wait_until(WaitWord& w, Op try_op) {
+    if (try_op()) {
+        return true;
+    }
+    WaitTimer timer;
+    if (wait_spin((uintptr_t)&w, try_op)) {
+        return true;
+    }
+    while (!try_op()) {
+        if (wait_stopping()) {
+            return false;
+        }
+        w.waiters.fetch_add(1);
+        uint32_t seen = w.seq.load();
+        if (try_op()) {
+            w.waiters.fetch_sub(1);
+            return true;
+        }
+        futex_wait(&w.seq, seen);
+        w.waiters.fetch_sub(1);
+    }
+    return true;
+}
+
+// Initialize the ring inside shared memory, with its capacity (a power of two) slots at slots
+inline void ring_init(TickRing* r, int capacity, RingSlot* slots) {
+    r->capacity = capacity;
+    r->mask = capacity - 1;
+    r->slots_offset = reinterpret_cast<char*>(slots) - reinterpret_cast<char*>(r);
+    for (int i = 0; i < capacity; i++) {
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    r->head.store(0, std::memory_order_relaxed);
+    r->tail.store(0, std::memory_order_relaxed);
+    r->not_full.seq.store(0);
+    r->not_full.waiters.store(0);
+    r->not_empty.seq.store(0);
+    r->not_empty.waiters.store(0);
+}
+
+// The slot/sequence core of the lock-free rings, shared by TickRing (mask from the segment, set at runtime)
+// and RingBuffer<T, Capacity, LockFreeSync> (constexpr mask). Any number of producers, one consumer.
+
+// Claim n consecutive slots with a single CAS on tail and publish items in them.
+// Returns false if fewer than n are free.
+template <typename T>
+inline bool seq_ring_try_push(std::atomic<uint64_t>& tail, SeqSlot<T> slots[], uint64_t mask, const T items[], int n) {
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+        // The consumer frees slots in order, so if the last one is free all of them are
+        uint64_t last = pos + n - 1;
+        uint64_t seq = slots[last & mask].seq.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)last;
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // slot still holds an unread item from the previous lap
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        SeqSlot<T>* slot = &slots[(pos + i) & mask];
+        slot->item = items[i];
+        slot->seq.store(pos + i + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+// Take every filled slot (up to max) at head, freeing each for the next lap. Returns how many were taken.
+template <typename T>
+inline int seq_ring_try_pop(std::atomic<uint64_t>& head, SeqSlot<T> slots[], uint64_t mask, T items[], int max) {
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    int n = 0;
+    while (n < max) {
+        SeqSlot<T>* slot = &slots[(pos + n) & mask];
+        if (slot->seq.load(std::memory_order_acquire) != pos + n + 1) {
+            break;
+        }
+        items[n] = slot->item;
+        slot->seq.store(pos + n + mask + 1, std::memory_order_release);
+        n++;
+    }
+    if (n > 0) {
+        head.store(pos + n, std::memory_order_relaxed);
+    }
+    return n;
+}
+
+// Claim a slot and publish one price. Returns false if the ring is full.
+inline bool ring_try_push(TickRing* r, const Tick& tick) {
+    return seq_ring_try_push(r->tail, ring_slots(r), r->mask, &tick, 1);
+}
+
+// Claim n consecutive slots with a single CAS and publish them. Returns false if fewer than n are free.
+inline bool ring_try_push_batch(TickRing* r, const Tick ticks[], int n) {
+    return seq_ring_try_push(r->tail, ring_slots(r), r->mask, ticks, n);
+}
+
+// Take one price out of the ring. Returns false if the ring is empty. Consumer only.
+inline bool ring_try_pop(TickRing* r, Tick& tick) {
+    return seq_ring_try_pop(r->head, ring_slots(r), r->mask, &tick, 1) == 1;
+}
+
+// Take every filled slot (up to max) out of the ring. Returns how many were taken. Consumer only.
+inline int ring_try_pop_batch(TickRing* r, Tick ticks[], int max) {
+    return seq_ring_try_pop(r->head, ring_slots(r), r->mask, ticks, max);
+}
+
+// The blocking ring operations below give up when the process is stopping (wait_request_stop):
+// pushes return false, pops take nothing.
+
+// Push, sleeping on the futex only while the ring is full.
+inline bool ring_push(TickRing* r, const Tick& tick) {
+    if (!wait_until(r->not_full, [&] { return ring_try_push(r, tick); })) {
+        return false;
+    }
+    wake_waiters(r->not_empty);
+    return true;
+}
+
+// Pop, sleeping on the futex only while the ring is empty.
+inline bool ring_pop(TickRing* r, Tick& tick) {
+    if (!wait_until(r->not_empty, [&] { return ring_try_pop(r, tick); })) {
+        return false;
+    }
+    wake_waiters(r->not_full);
+    return true;
+}
+
+// Push a whole batch at once (n must not exceed the ring capacity), then wake the reader on not_empty.
+inline bool ring_push_batch(TickRing* r, const Tick ticks[], int n, WaitWord& not_empty) {
+    if (!wait_until(r->not_full, [&] { return ring_try_push_batch(r, ticks, n); })) {
+        return false;
+    }
+    wake_waiters(not_empty);
+    return true;
+}
+
+inline bool ring_push_batch(TickRing* r, const Tick ticks[], int n) {
+    return ring_push_batch(r, ticks, n, r->not_empty);
+}
+
+// Wait for at least one price, then drain up to max. Returns how many were taken.
+inline int ring_pop_batch(TickRing* r, Tick ticks[], int max) {
+    int n = 0;
+    wait_until(r->not_empty, [&] { return (n = ring_try_pop_batch(r, ticks, max)) > 0; });
+    wake_waiters(r->not_full);
+    return n;
+}
+
+// ---------------------------------------- Sharded rings ----------------------------------------
+
+// Initialize the SHARD_COUNT rings, their slots back to back at slots
+inline void shards_init(SharedBuffer* sb, int capacity, RingSlot* slots) {
+    for (int i = 0; i < SHARD_COUNT; i++) {
+        ring_init(&sb->shards[i], capacity, slots + (size_t)i * capacity);
+    }
+    sb->shard_doorbell.seq.store(0);
+    sb->shard_doorbell.waiters.store(0);
+    sb->next_shard = 0;
+}
+
+// Push a batch of one symbol into that symbol's shard; only producers of symbols sharing a shard contend.
+inline bool shard_push_batch(SharedBuffer* sb, const Tick ticks[], int n) {
+    return ring_push_batch(&sb->shards[ticks[0].comm_index % SHARD_COUNT], ticks, n, sb->shard_doorbell);
+}
+
+// Poll every shard once, starting after the last one served. Returns how many prices were taken. Consumer only.
+inline int shards_try_pop_batch(SharedBuffer* sb, Tick ticks[], int max) {
+    int n = 0;
+    int start = sb->next_shard;
+    for (int i = 0; i < SHARD_COUNT && n < max; i++) {
+        TickRing* r = &sb->shards[(start + i) % SHARD_COUNT];
+        int taken = ring_try_pop_batch(r, ticks + n, max - n);
+        if (taken > 0) {
+            n += taken;
+            wake_waiters(r->not_full);
+        }
+    }
+    sb->next_shard = (start + 1) % SHARD_COUNT;
+    return n;
+}
+
+// Wait until some shard has prices, then drain up to max across shards.
+inline int shards_pop_batch(SharedBuffer* sb, Tick ticks[], int max) {
+    int n = 0;
+    wait_until(sb->shard_doorbell, [&] { return (n = shards_try_pop_batch(sb, ticks, max)) > 0; });
+    return n;
+}
+
+// ---------------------------------------- Broadcast ring ----------------------------------------
+// The ring is written once and read by up to MAX_READERS consumers, each with its own cursor
+// (disruptor style). A slot holds seq == pos + 1 once the tick for pos is published and 0 while
+// a producer is rewriting it. Producers may only claim positions less than a full ring ahead of
+// the slowest gating reader; lossy readers jump to the tail when they have been lapped.
+
+// Initialize the broadcast ring with capacity (a power of two) slots at slots
+inline void broadcast_init(SharedBuffer* sb, int capacity, RingSlot* slots) {
+    ring_init(&sb->ring, capacity, slots);
+    for (int i = 0; i < capacity; i++) {
+        slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < MAX_READERS; i++) {
+        sb->readers[i].position.store(0, std::memory_order_relaxed);
+        sb->readers[i].state.store(READER_FREE, std::memory_order_relaxed);
+        sb->readers[i].pid = 0;
+    }
+    sb->reader_gate.store(0, std::memory_order_relaxed);
+}
+
+// Free a gating cursor whose reader died without unregistering, so producers stop waiting for it.
+// Only gating cursors are reaped: their pid is set before they become gating, and lossy ones never hold
+// producers back. Returns true if it was freed.
+inline bool broadcast_reap(SharedBuffer* sb, ReaderCursor* reader) {
+    uint32_t expected = READER_GATING;
+    if (reader->state.load(std::memory_order_acquire) != READER_GATING) {
+        return false;
+    }
+    int pid = reader->pid;
+    if (pid_alive(pid) || reader->pid != pid || !reader->state.compare_exchange_strong(expected, READER_FREE)) {
+        return false;
+    }
+    wake_waiters(sb->ring.not_full);
+    return true;
+}
+
+// Take a free cursor starting at the current tail, after freeing the gating cursors of dead readers.
+// Returns nullptr if every cursor is in use.
+inline ReaderCursor* broadcast_register(SharedBuffer* sb, bool lossy) {
+    for (int i = 0; i < MAX_READERS; i++) {
+        broadcast_reap(sb, &sb->readers[i]);
+    }
+    for (int i = 0; i < MAX_READERS; i++) {
+        ReaderCursor* reader = &sb->readers[i];
+        uint32_t expected = READER_FREE;
+        if (reader->state.load() == READER_FREE && reader->state.compare_exchange_strong(expected, READER_LOSSY)) {
+            reader->pid = getpid();
+            reader->position.store(sb->ring.tail.load());
+            if (!lossy) {
+                reader->state.store(READER_GATING);
+            }
+            return reader;
+        }
+    }
+    return nullptr;
+}
+
+// Give the cursor back; producers stop waiting for it.
+inline void broadcast_unregister(SharedBuffer* sb, ReaderCursor* reader) {
+    reader->state.store(READER_FREE);
+    wake_waiters(sb->ring.not_full);
+}
+
+// Position of the slowest live gating reader, or limit if there is none or all are ahead of it.
+// Only called when the ring looks full, so it can afford to free the cursors of readers that died.
+inline uint64_t broadcast_gate(SharedBuffer* sb, uint64_t limit) {
+    uint64_t gate = limit;
+    for (int i = 0; i < MAX_READERS; i++) {
+        if (sb->readers[i].state.load(std::memory_order_acquire) == READER_GATING && !broadcast_reap(sb, &sb->readers[i])) {
+            uint64_t position = sb->readers[i].position.load(std::memory_order_acquire);
+            if (position < gate) {
+                gate = position;
+            }
+        }
+    }
+    return gate;
+}
+
+// Claim n positions if no gating reader would be overwritten. Returns false if the ring is full for them.
+inline bool broadcast_try_claim(SharedBuffer* sb, int n, uint64_t& pos) {
+    TickRing* r = &sb->ring;
+    // Slowest gating reader seen last time, kept in the segment so it always belongs to this ring.
+    // Readers only move forward and new ones start at the tail, so it stays a lower bound; it is only
+    // rescanned when the ring looks full.
+    pos = r->tail.load(std::memory_order_relaxed);
+    for (;;) {
+        uint64_t end = pos + n;
+        uint64_t gate = sb->reader_gate.load(std::memory_order_relaxed);
+        if (end > gate + r->capacity) {
+            gate = broadcast_gate(sb, pos);
+            sb->reader_gate.store(gate, std::memory_order_relaxed);
+            if (end > gate + r->capacity) {
+                return false;
+            }
+        }
+        if (r->tail.compare_exchange_weak(pos, end, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+// Publish a batch to every reader, sleeping only while the slowest gating reader is a full ring behind.
+// Returns false if the process is stopping before the batch could be placed.
+inline bool broadcast_push_batch(SharedBuffer* sb, const Tick ticks[], int n) {
+    TickRing* r = &sb->ring;
+    RingSlot* slots = ring_slots(r);
+    uint64_t pos = 0;
+    if (!wait_until(r->not_full, [&] { return broadcast_try_claim(sb, n, pos); })) {
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        uint64_t p = pos + i;
+        RingSlot* slot = &slots[p & r->mask];
+        // The producer of the previous lap may still be writing this slot
+        uint64_t previous = p >= r->capacity ? p - r->capacity + 1 : 0;
+        while (slot->seq.load(std::memory_order_acquire) != previous) {
+            sched_yield();
+        }
+        slot->seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot->item = ticks[i];
+        slot->seq.store(p + 1, std::memory_order_release);
+    }
+    wake_waiters(r->not_empty);
+    return true;
+}
+
+// Read up to max ticks at the reader's cursor. Lossy readers that were lapped skip to the tail
+// and add the lost ticks to skipped. Returns how many were read.
+inline int broadcast_try_pop_batch(SharedBuffer* sb, ReaderCursor* reader, Tick ticks[], int max, uint64_t& skipped) {
+    TickRing* r = &sb->ring;
+    RingSlot* slots = ring_slots(r);
+    bool lossy = reader->state.load(std::memory_order_relaxed) == READER_LOSSY;
+    uint64_t pos = reader->position.load(std::memory_order_relaxed);
+    int n = 0;
+    while (n < max) {
+        RingSlot* slot = &slots[(pos + n) & r->mask];
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq != pos + n + 1) {
+            break;
+        }
+        ticks[n] = slot->item;
+        if (lossy) {
+            // A producer may have started rewriting the slot while it was copied
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->seq.load(std::memory_order_relaxed) != seq) {
+                break;
+            }
+        }
+        n++;
+    }
+    if (n == 0 && lossy) {
+        uint64_t tail = r->tail.load(std::memory_order_acquire);
+        if (tail - pos > r->capacity) {
+            skipped += tail - pos;
+            reader->position.store(tail, std::memory_order_release);
+        }
+        return 0;
+    }
+    if (n > 0) {
+        reader->position.store(pos + n, std::memory_order_release);
+    }
+    return n;
+}
+
+// Wait for at least one tick at the reader's cursor, then read up to max.
+inline int broadcast_pop_batch(SharedBuffer* sb, ReaderCursor* reader, Tick ticks[], int max, uint64_t& skipped) {
+    int n = 0;
+    wait_until(sb->ring.not_empty, [&] { return (n = broadcast_try_pop_batch(sb, reader, ticks, max, skipped)) > 0; });
+    if (reader->state.load(std::memory_order_relaxed) == READER_GATING) {
+        wake_waiters(sb->ring.not_full);
+    }
+    return n;
+}
+
+// ---------------------------------------- Last-value cache ----------------------------------------
+// Conflated view of the feed for clients that only want the latest price of each commodity (./consumer --view).
+// Producers overwrite their commodity's entry before queueing a batch, so it is current even while they wait
+// for room, and readers take snapshots without ever making a producer wait. Each entry is a seqlock:
+// readers retry while the version is odd or changed under them. Producers of the same commodity take turns
+// through the version, one that doesn't get it within LVC_WRITE_TRIES skips the update, the next batch
+// brings a newer price anyway.
+
+#define LVC_EWMA_WINDOW DEFAULT_WINDOW   // Smoothing of LastValue::ewma, as RollingStats with the default window
+#define LVC_WRITE_TRIES 64
+#define LVC_READ_TRIES 1024
+
+inline void lvc_init(SharedBuffer* sb) {
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        LastValue& e = sb->last_values[i];
+        e.version.store(0, std::memory_order_relaxed);
+        e.ts_us = 0;
+        e.updates = 0;
+        e.price = e.mean = e.ewma = e.min = e.max = 0;
+    }
+}
+
+// Fold n ticks of one commodity into its entry. Returns false if other writers kept it busy.
+inline bool lvc_write(LastValue& e, const Tick ticks[], int n) {
+    uint32_t v = 0;
+    bool locked = false;
+    for (int i = 0; i < LVC_WRITE_TRIES && !locked; i++) {
+        v = e.version.load(std::memory_order_relaxed);
+        locked = (v & 1) == 0 && e.version.compare_exchange_weak(v, v + 1, std::memory_order_relaxed);
+        if (!locked) {
+            _mm_pause();
+        }
+    }
+    if (!locked) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_release);   // The odd version is seen before any field changes
+
+    const double alpha = 2.0 / (LVC_EWMA_WINDOW + 1);
+    for (int i = 0; i < n; i++) {
+        double price = ticks[i].price;
+        if (e.updates == 0) {
+            e.mean = e.ewma = e.min = e.max = price;
+        } else {
+            e.mean += (price - e.mean) / (e.updates + 1);
+            e.ewma += alpha * (price - e.ewma);
+            e.min = price < e.min ? price : e.min;
+            e.max = price > e.max ? price : e.max;
+        }
+        e.updates++;
+    }
+    e.price = ticks[n - 1].price;
+    e.ts_us = ticks[n - 1].ts_us;
+    e.version.store(v + 2, std::memory_order_release);
+    return true;
+}
+
+// Publish the latest prices of a batch, one entry write per run of the same commodity (producers)
+inline void lvc_update(SharedBuffer* sb, const Tick ticks[], int n) {
+    int start = 0;
+    for (int i = 1; i <= n; i++) {
+        if (i == n || ticks[i].comm_index != ticks[start].comm_index) {
+            if (ticks[start].comm_index < MAX_SYMBOLS) {
+                lvc_write(sb->last_values[ticks[start].comm_index], ticks + start, i - start);
+            }
+            start = i;
+        }
+    }
+}
+
+// Consistent copy of an entry, wait-free for the writers. Returns false if it was being written on every try.
+inline bool lvc_snapshot(const LastValue& e, LastValue& out) {
+    for (int i = 0; i < LVC_READ_TRIES; i++) {
+        uint32_t before = e.version.load(std::memory_order_acquire);
+        if ((before & 1) == 0) {
+            out.ts_us = e.ts_us;
+            out.updates = e.updates;
+            out.price = e.price;
+            out.mean = e.mean;
+            out.ewma = e.ewma;
+            out.min = e.min;
+            out.max = e.max;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e.version.load(std::memory_order_relaxed) == before) {
+                out.version.store(before, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        _mm_pause();
+    }
+    return false;
+}
+
+// Release entries left odd by a producer that died while writing them (consumer, when it takes a segment
+// over). A write takes nanoseconds, so an entry still odd and unchanged 10ms later has no live writer.
+inline void lvc_repair(SharedBuffer* sb) {
+    uint32_t seen[MAX_SYMBOLS];
+    bool any = false;
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        seen[i] = sb->last_values[i].version.load();
+        any = any || (seen[i] & 1);
+    }
+    if (!any) {
+        return;
+    }
+    usleep(10000);
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        uint32_t v = seen[i];
+        if (v & 1) {
+            sb->last_values[i].version.compare_exchange_strong(v, v + 1);
+        }
+    }
+}
+
+// ---------------------------------------- Publishing ----------------------------------------
+
+// Place n ticks on the buffer with whatever transport the consumer chose, updating the last-value cache.
+// n may exceed the buffer capacity, the ticks then go in capacity-sized pieces, each counted as a batch
+// in metrics. on_enqueue(first, count) runs for each piece just before it goes in: inside the semaphore
+// transport's critical section, before the ring push otherwise (the producer stamps enqueue_lag there).
+// When the process is stopping (wait_request_stop) it may return with the rest unplaced.
+template <typename OnEnqueue>
+inline void publish_ticks(SharedBuffer* sb, const Tick ticks[], int n, ProducerMetrics* metrics, OnEnqueue on_enqueue) {
+    lvc_update(sb, ticks, n);
+    SharedHeader& header = sb->header;
+    for (int done = 0; done < n; ) {
+        int now = n - done < header.buffer_size ? n - done : header.buffer_size;
+        const Tick* piece = ticks + done;
+        uint64_t waited = wait_thread_ns();
+        bool placed = true;
+        if (header.transport == TRANSPORT_SEMAPHORE) {
+            if (!semWait(header.sem_available_id, now)) {
+                return;
+            }
+            if (!semLock(header.sem_mutex_id)) {
+                semSignal(header.sem_available_id, now);    // Give the room back
+                return;
+            }
+            on_enqueue(done, now);
+            push_batch(sb, piece, now);
+            semSignal(header.sem_filled_id, now);       // Under the mutex, so filled matches count there
+            semUnlock(header.sem_mutex_id);
+        } else {
+            // A full ring shows up as queue latency instead, the wait happens inside the push
+            on_enqueue(done, now);
+            if (header.transport == TRANSPORT_LOCKFREE) {
+                placed = ring_push_batch(&sb->ring, piece, now);
+            } else if (header.transport == TRANSPORT_BROADCAST) {
+                placed = broadcast_push_batch(sb, piece, now);
+            } else {
+                // Push each symbol's run to its own shard
+                int start = 0;
+                for (int i = 1; i <= now && placed; i++) {
+                    if (i == now || piece[i].comm_index != piece[start].comm_index) {
+                        placed = shard_push_batch(sb, piece + start, i - start);
+                        start = i;
+                    }
+                }
+            }
+        }
+        if (!placed) {
+            return;
+        }
+        metrics_published(metrics, now, wait_thread_ns() - waited);
+        done += now;
+    }
+}
+
+// For processes that inject ticks they didn't generate (replay, bridge)
+inline void publish_ticks(SharedBuffer* sb, const Tick ticks[], int n, ProducerMetrics* metrics) {
+    publish_ticks(sb, ticks, n, metrics, [](int, int) {});
+}
+
+#endif
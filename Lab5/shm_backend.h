@@ -0,0 +1,299 @@
+#ifndef SHM_BACKEND_H
+#define SHM_BACKEND_H
+
+// Where the shared segment lives. By default it is a SysV segment keyed by ftok("consumer", 65),
+// which depends on the working directory. With a name it is a POSIX shared memory object instead
+// (or a file on hugetlbfs when huge pages are requested), so several instances can run side by side.
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define HUGETLBFS_DIR "/dev/hugepages"
+
+struct ShmOptions {
+    std::string name;       // Empty for SysV, otherwise a POSIX name such as "/lab5"
+    bool hugepages;         // Back the segment with 2MB pages (SHM_HUGETLB / hugetlbfs + MAP_HUGETLB)
+    bool prefault;          // Fault every page in up front (MAP_POPULATE) and mlock it
+    bool readonly;          // Attach without write access (monitoring tools), shm_attach only
+
+    ShmOptions() : hugepages(false), prefault(false), readonly(false) {}
+};
+
+struct ShmSegment {
+    void* addr;             // Where the segment is attached in this process
+    size_t size;            // Mapped size in bytes
+    int shm_id;             // SysV id, -1 for the POSIX backend
+    std::string path;       // POSIX object name or hugetlbfs file, empty for SysV
+    bool hugetlbfs;         // path is a file on hugetlbfs rather than a POSIX object
+
+    ShmSegment() : addr(nullptr), size(0), shm_id(-1), hugetlbfs(false) {}
+};
+
+// Parse one backend option at argv[i]. Returns how many arguments it used (0 if it isn't one).
+inline int shm_parse_option(ShmOptions& options, int argc, char* argv[], int i) {
+    if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+        options.name = argv[i + 1];
+        if (options.name[0] != '/') {
+            options.name = "/" + options.name;
+        }
+        return 2;
+    }
+    if (strcmp(argv[i], "--hugepages") == 0) {
+        options.hugepages = true;
+        return 1;
+    }
+    if (strcmp(argv[i], "--prefault") == 0) {
+        options.prefault = true;
+        return 1;
+    }
+    return 0;
+}
+
+// Human readable description of the backend for startup messages
+inline std::string shm_describe(const ShmOptions& options) {
+    std::string backend;
+    if (options.name.empty()) {
+        backend = options.hugepages ? "SysV shmget (huge pages)" : "SysV shmget";
+    } else if (options.hugepages) {
+        backend = "hugetlbfs " HUGETLBFS_DIR + options.name;
+    } else {
+        backend = "POSIX shm " + options.name;
+    }
+    if (options.prefault) {
+        backend += ", prefaulted";
+    }
+    return backend;
+}
+
+inline size_t shm_round_size(const ShmOptions& options, size_t size) {
+    if (options.hugepages) {
+        return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+    return size;
+}
+
+inline void shm_remove(ShmSegment& seg);
+
+// Map an open POSIX/hugetlbfs file descriptor
+inline bool shm_map_fd(const ShmOptions& options, int fd, ShmSegment& seg) {
+    int flags = MAP_SHARED;
+    if (options.prefault) {
+        flags |= MAP_POPULATE;
+    }
+    if (options.hugepages) {
+        flags |= MAP_HUGETLB;
+    }
+    void* addr = mmap(nullptr, seg.size, options.readonly ? PROT_READ : PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("Failed to map shared memory");
+        return false;
+    }
+    seg.addr = addr;
+    return true;
+}
+
+// Lock the pages in memory once they are mapped (best effort, needs RLIMIT_MEMLOCK)
+inline void shm_prefault(const ShmOptions& options, ShmSegment& seg) {
+    if (!options.prefault) {
+        return;
+    }
+    if (seg.shm_id != -1 && !options.readonly) {
+        // shmat has no MAP_POPULATE, touch every page instead
+        volatile char* p = static_cast<char*>(seg.addr);
+        for (size_t off = 0; off < seg.size; off += 4096) {
+            p[off] = p[off];
+        }
+    }
+    if (mlock(seg.addr, seg.size) == -1) {
+        perror("Warning: failed to lock shared memory pages");
+    }
+}
+
+// Create and attach a new segment of at least size bytes (consumer). Returns false after printing the error.
+inline bool shm_create(const ShmOptions& options, size_t size, ShmSegment& seg) {
+    seg.size = shm_round_size(options, size);
+    if (options.name.empty()) {
+        // Generate unique key for shared memory
+        key_t sharedm_key = ftok("consumer", 65);
+        if (sharedm_key == -1) {
+            perror("Failed to generate shared memory key in the consumer.");
+            return false;
+        }
+        int flags = 0666 | IPC_CREAT | IPC_EXCL;
+        if (options.hugepages) {
+            flags |= SHM_HUGETLB;
+        }
+        seg.shm_id = shmget(sharedm_key, seg.size, flags);
+        if (seg.shm_id == -1) {
+            if (errno == EEXIST) {
+                std::cerr << "Shared memory already exists. Ensure no conflicting memory segments are present.\n";
+            }
+            perror("Shared memory creation failed");
+            return false;
+        }
+        std::cout << "Shared memory id: " << seg.shm_id << " \n";
+        seg.addr = shmat(seg.shm_id, nullptr, 0);
+        if (seg.addr == (void *)-1) {
+            perror("Shared memory attachment failed in consumer.");
+            seg.addr = nullptr;
+            shmctl(seg.shm_id, IPC_RMID, nullptr);
+            return false;
+        }
+    } else {
+        int fd;
+        if (options.hugepages) {
+            seg.path = std::string(HUGETLBFS_DIR) + options.name;
+            seg.hugetlbfs = true;
+            fd = open(seg.path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+        } else {
+            seg.path = options.name;
+            fd = shm_open(seg.path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+        }
+        if (fd == -1) {
+            if (errno == EEXIST) {
+                std::cerr << "Shared memory " << seg.path << " already exists. Ensure no other consumer uses this name.\n";
+            }
+            perror("Shared memory creation failed");
+            return false;
+        }
+        if (ftruncate(fd, seg.size) == -1) {
+            perror("Failed to size shared memory");
+            close(fd);
+            shm_remove(seg);
+            return false;
+        }
+        if (!shm_map_fd(options, fd, seg)) {
+            shm_remove(seg);
+            return false;
+        }
+        std::cout << "Shared memory: " << seg.path << " \n";
+    }
+    shm_prefault(options, seg);
+    return true;
+}
+
+// Attach to the segment created by the consumer (producers). Returns false after printing the error.
+inline bool shm_attach(const ShmOptions& options, ShmSegment& seg) {
+    if (options.name.empty()) {
+        key_t sharedm_key = ftok("consumer", 65); // uses same consumer key to access the shared memory
+        if (sharedm_key == -1) {
+            perror("Failed to generate shared memory key");
+            return false;
+        }
+        // Doesnt create the shared memory if doesnt exist, the size comes from the segment itself
+        seg.shm_id = shmget(sharedm_key, 0, 0666);
+        if (seg.shm_id == -1) {
+            if (errno == ENOENT) {
+                std::cerr << "Error: Shared memory does not exist. Please run the consumer first to create shared memory.\n";
+            } else {
+                perror("Failed to access shared memory");
+            }
+            return false;
+        }
+        struct shmid_ds shm_info;
+        if (shmctl(seg.shm_id, IPC_STAT, &shm_info) == -1) {
+            perror("Failed to read shared memory size");
+            return false;
+        }
+        seg.size = shm_info.shm_segsz;
+        seg.addr = shmat(seg.shm_id, nullptr, options.readonly ? SHM_RDONLY : 0);
+        if (seg.addr == (void *)-1) {
+            perror("Failed to attach to shared memory");
+            seg.addr = nullptr;
+            return false;
+        }
+    } else {
+        int fd;
+        if (options.hugepages) {
+            seg.path = std::string(HUGETLBFS_DIR) + options.name;
+            seg.hugetlbfs = true;
+            fd = open(seg.path.c_str(), options.readonly ? O_RDONLY : O_RDWR);
+        } else {
+            seg.path = options.name;
+            fd = shm_open(seg.path.c_str(), options.readonly ? O_RDONLY : O_RDWR, 0666);
+        }
+        if (fd == -1) {
+            if (errno == ENOENT) {
+                std::cerr << "Error: Shared memory " << seg.path << " does not exist. Please run the consumer first to create shared memory.\n";
+            } else {
+                perror("Failed to access shared memory");
+            }
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            perror("Failed to read shared memory size");
+            close(fd);
+            return false;
+        }
+        seg.size = st.st_size;
+        if (!shm_map_fd(options, fd, seg)) {
+            return false;
+        }
+    }
+    shm_prefault(options, seg);
+    return true;
+}
+
+// Whether a segment already exists for these options (left behind by a consumer that died, say)
+inline bool shm_exists(const ShmOptions& options) {
+    if (options.name.empty()) {
+        key_t sharedm_key = ftok("consumer", 65);
+        return sharedm_key != -1 && shmget(sharedm_key, 0, 0) != -1;
+    }
+    std::string path = options.hugepages ? std::string(HUGETLBFS_DIR) + options.name : "/dev/shm" + options.name;
+    return access(path.c_str(), F_OK) == 0;
+}
+
+// Processes attached to a SysV segment (shm_nattch), -1 for the POSIX backend which doesn't count them
+inline int shm_attach_count(const ShmSegment& seg) {
+    struct shmid_ds info;
+    if (seg.shm_id == -1 || shmctl(seg.shm_id, IPC_STAT, &info) == -1) {
+        return -1;
+    }
+    return (int)info.shm_nattch;
+}
+
+// Detach from the segment. Safe to call from a signal handler.
+inline void shm_detach(ShmSegment& seg) {
+    if (!seg.addr) {
+        return;
+    }
+    int result = seg.shm_id != -1 ? shmdt(seg.addr) : munmap(seg.addr, seg.size);
+    if (result == -1) {
+        perror("Failed to detach shared memory");
+    } else {
+        printf("Shared memory detached successfully.\n");
+    }
+    seg.addr = nullptr;
+}
+
+// Remove the segment (consumer only, to avoid producers deleting it)
+inline void shm_remove(ShmSegment& seg) {
+    int result;
+    if (seg.shm_id != -1) {
+        result = shmctl(seg.shm_id, IPC_RMID, nullptr);
+    } else if (seg.hugetlbfs) {
+        result = unlink(seg.path.c_str());
+    } else {
+        result = shm_unlink(seg.path.c_str());
+    }
+    if (result == -1) {
+        perror("Failed to delete shared memory");
+    } else {
+        printf("Shared memory deleted successfully.\n");
+    }
+}
+
+#endif
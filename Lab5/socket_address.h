@@ -0,0 +1,97 @@
+#ifndef SOCKET_ADDRESS_H
+#define SOCKET_ADDRESS_H
+
+// Stream sockets named by the tools' ADDRESS arguments: unix:PATH or tcp:HOST:PORT (tcp:PORT to listen
+// on every interface).
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Open a stream socket for address, connected or listening. Returns -1 after printing the error.
+// tcp tells whether it is a TCP socket; unix_path receives the socket file a listener created,
+// for the caller to unlink when it is done.
+inline int socket_open(const std::string& address, bool listen_on, bool& tcp, std::string& unix_path) {
+    tcp = address.compare(0, 4, "tcp:") == 0;
+    if (address.compare(0, 5, "unix:") == 0) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Error: invalid unix socket path " << path << ".\n";
+            return -1;
+        }
+        strcpy(addr.sun_path, path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            perror("Failed to create the socket");
+            return -1;
+        }
+        if (listen_on) {
+            unlink(path.c_str());       // Left by a receiver that was killed
+            if (bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, 1) == -1) {
+                perror(("Failed to listen on " + path).c_str());
+                close(fd);
+                return -1;
+            }
+            unix_path = path;
+        } else if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+            perror(("Failed to connect to " + path).c_str());
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    if (!tcp) {
+        std::cerr << "Error: address must be unix:PATH or tcp:HOST:PORT.\n";
+        return -1;
+    }
+
+    std::string rest = address.substr(4);
+    size_t colon = rest.rfind(':');
+    std::string host = colon == std::string::npos ? "" : rest.substr(0, colon);
+    std::string port = colon == std::string::npos ? rest : rest.substr(colon + 1);
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listen_on ? AI_PASSIVE : 0;
+    addrinfo* found = nullptr;
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+    if (error != 0) {
+        std::cerr << "Error: can't resolve " << rest << ": " << gai_strerror(error) << ".\n";
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* ai = found; ai && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        int on = 1;
+        bool ok;
+        if (listen_on) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 1) == 0;
+        } else {
+            ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        }
+        if (!ok) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd == -1) {
+        perror(("Failed to " + std::string(listen_on ? "listen on " : "connect to ") + rest).c_str());
+    }
+    return fd;
+}
+
+#endif
@@ -0,0 +1,388 @@
+// Live counters of a shared buffer: queue depth, consumer and producer throughput, producer back-pressure
+// and ticks per symbol. Attaches read-only and only reads what the processes keep in the segment anyway
+// (SharedBuffer::metrics, the last-value cache, ring positions), so it never slows them down.
+// Prints a table of rates every interval, or Prometheus text exposition: to stdout, to a file (replaced
+// atomically, for a textfile collector) or over HTTP on a socket (curl --unix-socket PATH http://lab5/metrics).
+//
+// Usage: ./stats [--interval S] [--count N] [--prometheus] [--output FILE] [--shm NAME] [--hugepages]
+//        ./stats --listen unix:PATH|tcp:[HOST:]PORT [--shm NAME] [--hugepages]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <cmath>
+#include <sys/socket.h>
+
+#include "shared_buffer.h"
+#include "shm_backend.h"
+#include "socket_address.h"
+
+ShmSegment segment;
+const SharedBuffer* shared_buffer = nullptr;
+std::string unix_path;          // --listen socket file, removed on exit
+
+void handle_sigint(int sig) {
+    (void)sig;
+    if (!unix_path.empty()) {
+        unlink(unix_path.c_str());
+    }
+    shm_detach(segment);
+    exit(0);
+}
+
+struct ProducerRow {
+    int slot;
+    int pid;                // 0 once the producer has gone
+    uint64_t ticks;
+    uint64_t batches;
+    uint64_t blocked;
+    uint64_t blocked_ns;
+};
+
+struct ReaderRow {
+    int slot;
+    int pid;
+    bool lossy;
+    uint64_t lag;           // Ticks published that it hasn't read
+};
+
+struct SymbolRow {
+    std::string name;
+    uint64_t ticks;
+    bool priced;            // Has a consistent last price
+    double price;
+};
+
+// Everything read from the segment at one time
+struct Snapshot {
+    uint64_t time_ns;
+    uint64_t depth;         // Ticks queued (broadcast: behind the slowest reader)
+    uint64_t consumer_ticks;
+    uint64_t consumer_batches;
+    uint64_t consumer_idle_ns;
+    uint64_t consumer_skipped;
+    std::vector<ProducerRow> producers;
+    std::vector<ReaderRow> readers;
+    std::vector<SymbolRow> symbols;
+};
+
+const char* transport_name(int transport) {
+    static const char* names[] = {"sem", "lockfree", "sharded", "broadcast"};
+    return transport >= 0 && transport <= TRANSPORT_BROADCAST ? names[transport] : "unknown";
+}
+
+uint64_t ring_depth(const TickRing& r) {
+    uint64_t tail = r.tail.load(std::memory_order_relaxed);
+    uint64_t head = r.head.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+Snapshot take_snapshot() {
+    const SharedBuffer* sb = shared_buffer;
+    Snapshot s;
+    s.time_ns = wait_clock_ns();
+    s.depth = 0;
+    int transport = sb->header.transport;
+    if (transport == TRANSPORT_SEMAPHORE) {
+        int filled = semctl(sb->header.sem_filled_id, 0, GETVAL);
+        s.depth = filled > 0 ? filled : 0;
+    } else if (transport == TRANSPORT_LOCKFREE) {
+        s.depth = ring_depth(sb->ring);
+    } else if (transport == TRANSPORT_SHARDED) {
+        for (int i = 0; i < SHARD_COUNT; i++) {
+            s.depth += ring_depth(sb->shards[i]);
+        }
+    } else {
+        uint64_t tail = sb->ring.tail.load(std::memory_order_relaxed);
+        for (int i = 0; i < MAX_READERS; i++) {
+            uint32_t state = sb->readers[i].state.load(std::memory_order_relaxed);
+            if (state == READER_FREE) {
+                continue;
+            }
+            uint64_t position = sb->readers[i].position.load(std::memory_order_relaxed);
+            ReaderRow row = {i, sb->readers[i].pid, state == READER_LOSSY, tail > position ? tail - position : 0};
+            s.readers.push_back(row);
+            if (row.lag > s.depth) {
+                s.depth = row.lag;
+            }
+        }
+    }
+
+    const Metrics& m = sb->metrics;
+    s.consumer_ticks = m.consumer.ticks.load(std::memory_order_relaxed);
+    s.consumer_batches = m.consumer.batches.load(std::memory_order_relaxed);
+    s.consumer_idle_ns = m.consumer.idle_ns.load(std::memory_order_relaxed);
+    s.consumer_skipped = m.consumer.skipped.load(std::memory_order_relaxed);
+    for (int i = 0; i < MAX_PRODUCERS; i++) {
+        const ProducerMetrics& p = m.producers[i];
+        int pid = sb->producers[i].load(std::memory_order_relaxed);
+        ProducerRow row = {i, pid_alive(pid) ? pid : 0, p.ticks.load(std::memory_order_relaxed), p.batches.load(std::memory_order_relaxed),
+                           p.blocked.load(std::memory_order_relaxed), p.blocked_ns.load(std::memory_order_relaxed)};
+        if (row.pid != 0 || row.batches > 0) {
+            s.producers.push_back(row);
+        }
+    }
+    uint32_t count = sb->symbols.count.load(std::memory_order_acquire);
+    for (uint32_t id = 0; id < count && id < MAX_SYMBOLS; id++) {
+        SymbolRow row;
+        row.name = symbol_name(&sb->symbols, id);
+        row.ticks = m.symbol_ticks[id].load(std::memory_order_relaxed);
+        LastValue value;
+        row.priced = lvc_snapshot(sb->last_values[id], value) && value.updates > 0;
+        row.price = row.priced ? value.price : NAN;
+        s.symbols.push_back(row);
+    }
+    return s;
+}
+
+// Per second between two snapshots
+double rate(uint64_t now, uint64_t before, double seconds) {
+    return seconds > 0 && now >= before ? (now - before) / seconds : 0;
+}
+
+const ProducerRow* find_producer(const Snapshot& s, int slot) {
+    for (size_t i = 0; i < s.producers.size(); i++) {
+        if (s.producers[i].slot == slot) {
+            return &s.producers[i];
+        }
+    }
+    return nullptr;
+}
+
+void print_table(const Snapshot& before, const Snapshot& now) {
+    const SharedHeader& header = shared_buffer->header;
+    double seconds = (now.time_ns - before.time_ns) / 1e9;
+    printf("\n%s transport, %d slots: depth %llu (%.1f%%)\n", transport_name(header.transport), header.buffer_size,
+           (unsigned long long)now.depth, 100.0 * now.depth / header.buffer_size);
+    printf("Consumer: %.0f ticks/s in %.0f batches/s, idle %.0f%%, %.0f skipped/s\n",
+           rate(now.consumer_ticks, before.consumer_ticks, seconds), rate(now.consumer_batches, before.consumer_batches, seconds),
+           std::min(100.0, rate(now.consumer_idle_ns, before.consumer_idle_ns, seconds) / 1e7),
+           rate(now.consumer_skipped, before.consumer_skipped, seconds));
+    for (size_t i = 0; i < now.readers.size(); i++) {
+        const ReaderRow& r = now.readers[i];
+        printf("Reader %d (pid %d, %s): %llu behind\n", r.slot, r.pid, r.lossy ? "lossy" : "gating", (unsigned long long)r.lag);
+    }
+    if (!now.producers.empty()) {
+        printf("%6s %8s %12s %12s %10s\n", "SLOT", "PID", "TICKS/S", "BLOCKED/S", "BLOCKED %");
+    }
+    for (size_t i = 0; i < now.producers.size(); i++) {
+        const ProducerRow& p = now.producers[i];
+        const ProducerRow* q = find_producer(before, p.slot);
+        ProducerRow zero = {p.slot, 0, 0, 0, 0, 0};
+        if (!q) {
+            q = &zero;
+        }
+        printf("%6d %8s %12.0f %12.0f %10.1f\n", p.slot, p.pid ? std::to_string(p.pid).c_str() : "gone",
+               rate(p.ticks, q->ticks, seconds), rate(p.blocked, q->blocked, seconds),
+               std::min(100.0, rate(p.blocked_ns, q->blocked_ns, seconds) / 1e7));
+    }
+    printf("%-24s %12s %12s\n", "SYMBOL", "TICKS/S", "LAST PRICE");
+    for (size_t i = 0; i < now.symbols.size(); i++) {
+        const SymbolRow& row = now.symbols[i];
+        uint64_t previous = i < before.symbols.size() ? before.symbols[i].ticks : 0;
+        if (row.ticks == 0 && !row.priced) {
+            continue;
+        }
+        printf("%-24s %12.0f %12.2f\n", row.name.c_str(), rate(row.ticks, previous, seconds), row.price);
+    }
+    fflush(stdout);
+}
+
+// One metric family in Prometheus text exposition format
+void family(std::ostream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+std::string prometheus_text(const Snapshot& s) {
+    const SharedHeader& header = shared_buffer->header;
+    std::ostringstream out;
+    out.precision(17);
+    std::string transport = std::string("{transport=\"") + transport_name(header.transport) + "\"}";
+    family(out, "lab5_queue_depth", "gauge", "Ticks waiting in the shared buffer (broadcast: behind the slowest reader).");
+    out << "lab5_queue_depth" << transport << " " << s.depth << "\n";
+    family(out, "lab5_queue_capacity", "gauge", "Slots in the shared buffer.");
+    out << "lab5_queue_capacity" << transport << " " << header.buffer_size << "\n";
+
+    family(out, "lab5_consumer_ticks_total", "counter", "Ticks drained by the consumer that owns the segment.");
+    out << "lab5_consumer_ticks_total " << s.consumer_ticks << "\n";
+    family(out, "lab5_consumer_batches_total", "counter", "Batches drained by the consumer.");
+    out << "lab5_consumer_batches_total " << s.consumer_batches << "\n";
+    family(out, "lab5_consumer_idle_seconds_total", "counter", "Time the consumer waited for ticks.");
+    out << "lab5_consumer_idle_seconds_total " << s.consumer_idle_ns / 1e9 << "\n";
+    family(out, "lab5_consumer_skipped_ticks_total", "counter", "Ticks a lossy broadcast consumer was lapped by.");
+    out << "lab5_consumer_skipped_ticks_total " << s.consumer_skipped << "\n";
+    if (!s.readers.empty()) {
+        family(out, "lab5_reader_lag_ticks", "gauge", "Ticks published that a broadcast reader hasn't read.");
+        for (size_t i = 0; i < s.readers.size(); i++) {
+            const ReaderRow& r = s.readers[i];
+            out << "lab5_reader_lag_ticks{reader=\"" << r.slot << "\",mode=\"" << (r.lossy ? "lossy" : "gating") << "\"} " << r.lag << "\n";
+        }
+    }
+
+    // Counters are labelled by entry: a producer taking over an entry continues its predecessor's counts
+    family(out, "lab5_producer_pid", "gauge", "Pid of the producer using the entry, 0 when it is free.");
+    for (size_t i = 0; i < s.producers.size(); i++) {
+        out << "lab5_producer_pid{slot=\"" << s.producers[i].slot << "\"} " << s.producers[i].pid << "\n";
+    }
+    family(out, "lab5_producer_ticks_total", "counter", "Ticks published.");
+    for (size_t i = 0; i < s.producers.size(); i++) {
+        out << "lab5_producer_ticks_total{slot=\"" << s.producers[i].slot << "\"} " << s.producers[i].ticks << "\n";
+    }
+    family(out, "lab5_producer_batches_total", "counter", "Batches published.");
+    for (size_t i = 0; i < s.producers.size(); i++) {
+        out << "lab5_producer_batches_total{slot=\"" << s.producers[i].slot << "\"} " << s.producers[i].batches << "\n";
+    }
+    family(out, "lab5_producer_blocked_batches_total", "counter", "Batches that waited for room in the buffer or for its mutex.");
+    for (size_t i = 0; i < s.producers.size(); i++) {
+        out << "lab5_producer_blocked_batches_total{slot=\"" << s.producers[i].slot << "\"} " << s.producers[i].blocked << "\n";
+    }
+    family(out, "lab5_producer_blocked_seconds_total", "counter", "Time producers waited for room in the buffer or for its mutex.");
+    for (size_t i = 0; i < s.producers.size(); i++) {
+        out << "lab5_producer_blocked_seconds_total{slot=\"" << s.producers[i].slot << "\"} " << s.producers[i].blocked_ns / 1e9 << "\n";
+    }
+
+    family(out, "lab5_symbol_ticks_total", "counter", "Ticks drained by the consumer per symbol.");
+    for (size_t i = 0; i < s.symbols.size(); i++) {
+        out << "lab5_symbol_ticks_total{symbol=\"" << s.symbols[i].name << "\"} " << s.symbols[i].ticks << "\n";
+    }
+    family(out, "lab5_symbol_last_price", "gauge", "Latest price published per symbol (last-value cache).");
+    for (size_t i = 0; i < s.symbols.size(); i++) {
+        if (s.symbols[i].priced) {
+            out << "lab5_symbol_last_price{symbol=\"" << s.symbols[i].name << "\"} " << s.symbols[i].price << "\n";
+        }
+    }
+    return out.str();
+}
+
+// Replace path with text, so a collector never reads half a file
+bool write_file(const std::string& path, const std::string& text) {
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary.c_str());
+    out << text;
+    out.close();
+    if (!out || rename(temporary.c_str(), path.c_str()) == -1) {
+        perror(("Failed to write " + path).c_str());
+        return false;
+    }
+    return true;
+}
+
+// Answer every connection with a fresh snapshot as an HTTP response, whatever it asked for
+int serve(int listen_fd) {
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to accept a connection");
+            return 1;
+        }
+        char request[1024];
+        recv(fd, request, sizeof(request), 0);     // Usually the whole request, the rest is ignored
+        std::string body = prometheus_text(take_snapshot());
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        const char* p = response.data();
+        size_t left = response.size();
+        while (left > 0) {
+            ssize_t sent = send(fd, p, left, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                break;
+            }
+            p += sent;
+            left -= sent;
+        }
+        close(fd);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    double interval = 1;
+    int count = 0;              // Snapshots before exiting, 0 to run until SIGINT
+    bool prometheus = false;
+    std::string output;
+    std::string listen_address;
+    ShmOptions shm_options;
+    shm_options.readonly = true;
+    for (int i = 1; i < argc; ) {
+        int used = shm_parse_option(shm_options, argc, argv, i);
+        if (used > 0) {
+            i += used;
+            continue;
+        }
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--interval") == 0 && has_value) {
+            interval = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--count") == 0 && has_value) {
+            count = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--prometheus") == 0) {
+            prometheus = true;
+        } else if (strcmp(argv[i], "--output") == 0 && has_value) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--listen") == 0 && has_value) {
+            listen_address = argv[++i];
+        } else {
+            std::cerr << "Error unknown option " << argv[i] << ".\n"
+                         "Usage: ./stats [--interval S] [--count N] [--prometheus] [--output FILE] [--shm NAME] [--hugepages]\n"
+                         "       ./stats --listen unix:PATH|tcp:[HOST:]PORT [--shm NAME] [--hugepages]\n";
+            return 1;
+        }
+        i++;
+    }
+    if (interval <= 0 || count < 0) {
+        std::cerr << "Error Invalid option value: --interval must be more than 0 seconds, --count 0 or more.\n";
+        return 1;
+    }
+    shm_options.prefault = false;   // Nothing to gain, and it would lock the whole segment in memory
+
+    signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);
+    if (!shm_attach(shm_options, segment)) {
+        return 1;
+    }
+    shared_buffer = (const SharedBuffer*)segment.addr;
+    const char* layout_error = header_check(shared_buffer, segment.size);
+    if (layout_error) {
+        std::cerr << "Error: " << layout_error << ".\n";
+        return 1;
+    }
+
+    if (!listen_address.empty()) {
+        bool tcp;
+        int fd = socket_open(listen_address, true, tcp, unix_path);
+        if (fd == -1) {
+            return 1;
+        }
+        printf("Serving metrics on %s.\n", listen_address.c_str());
+        fflush(stdout);
+        return serve(fd);
+    }
+
+    bool table = !prometheus && output.empty();
+    Snapshot before = take_snapshot();
+    for (int taken = 0; count == 0 || taken < count; taken++) {
+        if (taken > 0 || table) {
+            // Rates need a second snapshot, counters don't
+            usleep((useconds_t)(interval * 1e6));
+        }
+        Snapshot now = take_snapshot();
+        if (!output.empty()) {
+            write_file(output, prometheus_text(now));
+        } else if (!table) {
+            printf("%s\n", prometheus_text(now).c_str());
+            fflush(stdout);
+        } else {
+            print_table(before, now);
+        }
+        before = now;
+    }
+    return 0;       // Detached on exit without a message, stdout may be Prometheus text
+}
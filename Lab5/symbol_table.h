@@ -0,0 +1,126 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+// Registry of the instruments traded through a segment, in shared memory.
+// Names are registered at runtime (the consumer registers DEFAULT_SYMBOLS when it creates the segment,
+// producers add their own) and get dense ids 0, 1, 2... in registration order. Ticks only carry the id:
+// a producer resolves its names once at startup, nothing per tick looks at a string.
+// Lookup is lock-free: open addressing with linear probing over SYMBOL_HASH_SLOTS slots (never more than
+// half full), each slot 0 or id + 1, published after the name is written. Registering is serialized by
+// the caller (see symbol_register in shared_buffer.h), names are never removed.
+
+#include <atomic>
+#include <string>
+#include <cctype>
+#include <cstring>
+#include <stdint.h>
+
+#define MAX_SYMBOLS 4096                        // Instruments per segment, ids fit Tick::comm_index
+#define SYMBOL_NAME_SIZE 24                     // Name bytes including the terminating zero
+#define SYMBOL_HASH_SLOTS (2 * MAX_SYMBOLS)     // Power of two
+
+// The commodities every segment starts with, so the dashboard shows them before any producer runs
+const char* const DEFAULT_SYMBOLS[] = {
+    "ALUMINIUM",
+    "COPPER",
+    "COTTON",
+    "CRUDEOIL",
+    "GOLD",
+    "LEAD",
+    "MENTHAOIL",
+    "NATURAL_GAS",
+    "NICKEL",
+    "SILVER",
+    "ZINC"
+};
+const int DEFAULT_SYMBOL_COUNT = sizeof(DEFAULT_SYMBOLS) / sizeof(DEFAULT_SYMBOLS[0]);
+
+struct SymbolTable {
+    std::atomic<uint32_t> count;                    // Ids handed out
+    char names[MAX_SYMBOLS][SYMBOL_NAME_SIZE];      // By id
+    std::atomic<uint32_t> slots[SYMBOL_HASH_SLOTS]; // Hash table: id + 1, 0 for empty
+};
+
+// Canonical form of a name: upper case, spaces as '_' ("natural gas" is NATURAL_GAS).
+// Returns false if it is empty, too long, or has characters other than letters, digits and _ . - /
+inline bool symbol_normalize(const std::string& name, char out[SYMBOL_NAME_SIZE]) {
+    if (name.empty() || name.size() >= SYMBOL_NAME_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); i++) {
+        unsigned char c = name[i];
+        if (c == ' ') {
+            c = '_';
+        }
+        if (!isalnum(c) && c != '_' && c != '.' && c != '-' && c != '/') {
+            return false;
+        }
+        out[i] = (char)toupper(c);
+    }
+    memset(out + name.size(), 0, SYMBOL_NAME_SIZE - name.size());
+    return true;
+}
+
+// FNV-1a of a normalized name
+inline uint32_t symbol_hash(const char* name) {
+    uint32_t h = 2166136261u;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h;
+}
+
+inline void symbol_table_init(SymbolTable* table) {
+    table->count.store(0, std::memory_order_relaxed);
+    memset(table->names, 0, sizeof(table->names));
+    for (int i = 0; i < SYMBOL_HASH_SLOTS; i++) {
+        table->slots[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// Id of a normalized name, or -1. Lock-free, safe against concurrent registration.
+// slot receives where the probe ended: the name's slot, or the empty one it would go in.
+inline int symbol_find(const SymbolTable* table, const char* name, uint32_t& slot) {
+    slot = symbol_hash(name) & (SYMBOL_HASH_SLOTS - 1);
+    while (true) {
+        uint32_t entry = table->slots[slot].load(std::memory_order_acquire);
+        if (entry == 0) {
+            return -1;
+        }
+        if (strcmp(table->names[entry - 1], name) == 0) {
+            return (int)entry - 1;
+        }
+        slot = (slot + 1) & (SYMBOL_HASH_SLOTS - 1);
+    }
+}
+
+inline int symbol_find(const SymbolTable* table, const std::string& name) {
+    char normalized[SYMBOL_NAME_SIZE];
+    uint32_t slot;
+    return symbol_normalize(name, normalized) ? symbol_find(table, normalized, slot) : -1;
+}
+
+// Id of a normalized name, registering it if it is new. The caller must be the only one registering.
+// Returns -1 when the table is full.
+inline int symbol_insert(SymbolTable* table, const char* name) {
+    uint32_t slot;
+    int id = symbol_find(table, name, slot);
+    if (id != -1) {
+        return id;
+    }
+    uint32_t count = table->count.load(std::memory_order_relaxed);
+    if (count == MAX_SYMBOLS) {
+        return -1;
+    }
+    memcpy(table->names[count], name, SYMBOL_NAME_SIZE);
+    table->count.store(count + 1, std::memory_order_release);
+    table->slots[slot].store(count + 1, std::memory_order_release);     // Findable from here on
+    return (int)count;
+}
+
+// Name of a registered id
+inline const char* symbol_name(const SymbolTable* table, int id) {
+    return table->names[id];
+}
+
+#endif
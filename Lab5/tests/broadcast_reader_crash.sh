@@ -0,0 +1,53 @@
+#!/bin/sh
+# A gating broadcast reader that dies without unregistering must not hold producers back.
+# Stops an attached reader until the ring fills and the producer blocks, kills it with SIGKILL, then
+# checks that ticks flow again. Run from Lab5 after make (make check).
+
+SHM=lab5_reader_crash_$$
+CAPACITY=64
+
+consumer_ticks() {
+    ./stats --count 1 --prometheus --shm $SHM | awk '$1 == "lab5_consumer_ticks_total" { print $2 }'
+}
+
+cleanup() {
+    kill -9 $PRODUCER $READER $OWNER 2>/dev/null
+    wait 2>/dev/null
+    ./consumer --reset --shm $SHM > /dev/null 2>&1
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+./consumer $CAPACITY broadcast --headless --shm $SHM > /dev/null 2>&1 &
+OWNER=$!
+sleep 0.5
+./consumer --attach --headless --shm $SHM > /dev/null 2>&1 &
+READER=$!
+sleep 0.5
+kill -STOP $READER
+./producer GOLD 100 5 0 --shm $SHM > /dev/null 2>&1 &
+PRODUCER=$!
+sleep 1
+
+# The stopped reader gates the producer a ring ahead of it
+before=$(consumer_ticks)
+sleep 0.5
+blocked=$(consumer_ticks)
+[ -n "$before" ] || fail "no metrics from ./stats"
+[ "$blocked" -eq "$before" ] || fail "the producer wasn't blocked by the stopped reader ($before -> $blocked ticks)"
+[ "$blocked" -le $((2 * CAPACITY)) ] || fail "the producer got more than a ring ahead of the stopped reader ($blocked ticks)"
+
+kill -9 $READER
+wait $READER 2>/dev/null
+sleep 0.5
+after=$(consumer_ticks)
+sleep 0.5
+later=$(consumer_ticks)
+[ "$after" -gt "$blocked" ] && [ "$later" -gt "$after" ] ||
+    fail "producers made no progress after the reader died ($blocked -> $after -> $later ticks)"
+
+echo "PASS: producers kept going after the gating reader was killed ($blocked -> $later ticks)"
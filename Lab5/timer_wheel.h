@@ -0,0 +1,91 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Hashed timing wheel: timers are kept in one of a power-of-two number of slots by due tick,
+// so scheduling and expiring are O(1) however many timers there are. Timers further out than one
+// turn of the wheel simply stay in their slot until the wheel comes round to their turn.
+
+#include <vector>
+#include <stdint.h>
+
+class TimerWheel {
+public:
+    // tick_ns: slot width. slots: a power of two. Ticks are counted from start_ns.
+    TimerWheel(uint64_t tick_ns, int slots, uint64_t start_ns)
+        : slots_(slots), tick_ns_(tick_ns), mask_(slots - 1), start_ns_(start_ns), current_tick_(0), pending_(0) {}
+
+    // Fire id at due_ns. Timers already due go in the next slot processed.
+    void schedule(int id, uint64_t due_ns) {
+        uint64_t tick = tick_of(due_ns);
+        if (tick < current_tick_) {
+            tick = current_tick_;
+        }
+        Entry e = { id, tick };
+        slots_[tick & mask_].push_back(e);
+        pending_++;
+    }
+
+    // Process every slot up to now_ns, calling fire(id) for each expired timer. A fired timer is
+    // removed, fire() reschedules it if it should run again.
+    template <typename Fire>
+    void advance(uint64_t now_ns, Fire fire) {
+        uint64_t now_tick = tick_of(now_ns);
+        while (current_tick_ <= now_tick) {
+            std::vector<Entry>& slot = slots_[current_tick_ & mask_];
+            if (slot.empty()) {
+                current_tick_++;
+                continue;
+            }
+            expired_.clear();
+            size_t kept = 0;
+            for (size_t i = 0; i < slot.size(); i++) {
+                if (slot[i].tick <= current_tick_) {
+                    expired_.push_back(slot[i].id);
+                } else {
+                    slot[kept++] = slot[i];     // Due on a later turn of the wheel
+                }
+            }
+            slot.resize(kept);
+            pending_ -= expired_.size();
+            current_tick_++;    // Timers rescheduled from fire() land in a later slot
+            for (size_t i = 0; i < expired_.size(); i++) {
+                fire(expired_[i]);
+            }
+        }
+    }
+
+    // Start of the next slot that holds a timer (one turn ahead if the wheel is empty)
+    uint64_t next_ns() const {
+        uint64_t tick = current_tick_;
+        if (pending_ > 0) {
+            for (size_t n = 0; n < slots_.size(); n++, tick++) {
+                if (!slots_[tick & mask_].empty()) {
+                    break;
+                }
+            }
+        } else {
+            tick += slots_.size();
+        }
+        return start_ns_ + tick * tick_ns_;
+    }
+
+private:
+    struct Entry {
+        int id;
+        uint64_t tick;      // Absolute tick the timer is due on
+    };
+
+    uint64_t tick_of(uint64_t ns) const {
+        return ns <= start_ns_ ? 0 : (ns - start_ns_) / tick_ns_;
+    }
+
+    std::vector<std::vector<Entry> > slots_;
+    std::vector<int> expired_;
+    uint64_t tick_ns_;
+    uint64_t mask_;
+    uint64_t start_ns_;
+    uint64_t current_tick_;     // Next tick to process
+    size_t pending_;            // Timers in the wheel
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef WAIT_STRATEGY_H
+#define WAIT_STRATEGY_H
+
+// How a process waits for the buffer (semaphores and futex waits alike), set per process with --wait.
+// Blocking in the kernel costs a context switch on each side even when the condition would have come
+// true a few hundred nanoseconds later, so a waiter may poll first:
+//   spin      poll continuously, never sleep
+//   pause     poll with a pause instruction between tries (kinder to the other hyperthread)
+//   yield     poll, giving the CPU away between tries
+//   block     sleep at once (semop / futex)
+//   adaptive  pause-spin for a budget learned from recent waits, yield a few times, then sleep
+// Every strategy except block busy-polls, which only pays off when the other side has a CPU to run on.
+// On a single CPU adaptive always blocks.
+
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include <immintrin.h>
+
+#include "cpu_affinity.h"
+
+enum WaitStrategy {
+    WAIT_SPIN = 0,
+    WAIT_PAUSE = 1,
+    WAIT_YIELD = 2,
+    WAIT_BLOCK = 3,
+    WAIT_ADAPTIVE = 4
+};
+
+#define WAIT_MIN_SPIN 16            // Adaptive budget bounds, in polls
+#define WAIT_MAX_SPIN 8192
+#define WAIT_INITIAL_SPIN 256
+#define WAIT_YIELDS 4               // Yields after the spin budget, before sleeping
+#define WAIT_SITES 8                // Wait sites (semaphores, futex words) with their own budget, per thread
+#define WAIT_STOP_POLL_NS 100000000 // Longest a sleeping wait goes without looking at wait_stopping()
+
+// How the waits of this process ended, for reports
+struct WaitCounters {
+    std::atomic<uint64_t> spun;         // Satisfied while polling
+    std::atomic<uint64_t> yielded;      // Satisfied after giving the CPU away
+    std::atomic<uint64_t> blocked;      // Had to sleep in the kernel
+};
+
+inline WaitCounters& wait_counters() {
+    static WaitCounters counters = {{0}, {0}, {0}};
+    return counters;
+}
+
+// Nanoseconds the calling thread has spent in waits that weren't satisfied at once. The uncontended path
+// isn't timed, so this costs nothing until a wait really happens; callers diff it around an operation
+// to tell how long the buffer held them up.
+inline uint64_t& wait_thread_ns() {
+    static thread_local uint64_t ns = 0;
+    return ns;
+}
+
+inline uint64_t wait_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Adds its lifetime to wait_thread_ns, for the slow path of a wait
+struct WaitTimer {
+    uint64_t start;
+
+    WaitTimer() : start(wait_clock_ns()) {}
+    ~WaitTimer() { wait_thread_ns() += wait_clock_ns() - start; }
+};
+
+// Shutdown request. A signal handler may set it (a lock-free atomic store), then every wait on the buffer
+// gives up within WAIT_STOP_POLL_NS, so the threads in them return and can be joined.
+inline std::atomic<bool>& wait_stop_flag() {
+    static std::atomic<bool> stop(false);
+    return stop;
+}
+
+inline void wait_request_stop() {
+    wait_stop_flag().store(true);
+}
+
+inline bool wait_stopping() {
+    return wait_stop_flag().load(std::memory_order_relaxed);
+}
+
+// Block until a process picks its strategy with wait_set_strategy
+inline int& wait_strategy() {
+    static int strategy = WAIT_BLOCK;
+    return strategy;
+}
+
+// Set the process's strategy. Adaptive becomes block when there is nothing to spin against.
+inline void wait_set_strategy(int strategy) {
+    if (strategy == WAIT_ADAPTIVE && cpu_count() == 1) {
+        strategy = WAIT_BLOCK;
+    }
+    wait_strategy() = strategy;
+}
+
+inline const char* wait_strategy_name(int strategy) {
+    static const char* names[] = {"spin", "pause", "yield", "block", "adaptive"};
+    return names[strategy];
+}
+
+// Parse a --wait value. Returns -1 if it isn't one.
+inline int wait_parse_strategy(const char* name) {
+    for (int s = WAIT_SPIN; s <= WAIT_ADAPTIVE; s++) {
+        if (strcmp(name, wait_strategy_name(s)) == 0) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+// Adaptive spin budget of one wait site, moved an eighth of the way toward twice the polls the last
+// successful spin needed, or toward the minimum when spinning didn't help.
+inline int& wait_spin_budget(uintptr_t site) {
+    static thread_local int budgets[WAIT_SITES] = {0};
+    int& budget = budgets[(site ^ (site >> 6)) % WAIT_SITES];
+    if (budget == 0) {
+        budget = WAIT_INITIAL_SPIN;
+    }
+    return budget;
+}
+
+inline void wait_learn(int& budget, int target) {
+    budget += (target - budget) / 8;
+    if (budget < WAIT_MIN_SPIN) {
+        budget = WAIT_MIN_SPIN;
+    } else if (budget > WAIT_MAX_SPIN) {
+        budget = WAIT_MAX_SPIN;
+    }
+}
+
+// Poll try_op the way the process's strategy says before the caller sleeps. site identifies the wait
+// (semaphore id, futex word address) for the adaptive budget.
+// Returns true once try_op() succeeded, false if the caller should block (or give up, when stopping).
+template <typename Op>
+inline bool wait_spin(uintptr_t site, Op try_op) {
+    int strategy = wait_strategy();
+    if (strategy == WAIT_BLOCK) {
+        wait_counters().blocked.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (strategy != WAIT_ADAPTIVE) {
+        while (!try_op()) {
+            if (wait_stopping()) {
+                return false;
+            }
+            if (strategy == WAIT_PAUSE) {
+                _mm_pause();
+            } else if (strategy == WAIT_YIELD) {
+                sched_yield();
+            }
+        }
+        wait_counters().spun.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    int& budget = wait_spin_budget(site);
+    for (int i = 0; i < budget; i++) {
+        if (try_op()) {
+            wait_learn(budget, 2 * (i + 1));
+            wait_counters().spun.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        _mm_pause();
+    }
+    wait_learn(budget, 0);
+    for (int i = 0; i < WAIT_YIELDS; i++) {
+        sched_yield();
+        if (try_op()) {
+            wait_counters().yielded.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    wait_counters().blocked.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+#endif